@@ -4,35 +4,68 @@
 #include "src/parseInput/parseInput.h"
 #include "src/OutputGenerator.h"
 #include "src/synthesizer.h"
+#include "src/BatchGenerator.h"
+#include "src/propagator/DomainKernels.h"
 #include <chrono>
 #include <vector>
 #include <map>
+#include <mutex>
 
 using namespace std;
 using namespace std::chrono;
 
-int main() {
+// The path to write the given iteration of the sample to.
+string outputPath(const InputSettings& settings, int sample, int iteration) {
+    if (settings.type == "simpletiled" || settings.type == "overlapping") {
+        string extra = (sample + 1) < 10 ? "0" : "";
+        return "outputs/" + extra + to_string(sample + 1) + " " + settings.name + " " + settings.subset + " " + to_string(iteration) + ".png";
+    }
+    return "outputs/" + to_string(sample + 1) + " " + to_string(iteration) + " " + settings.name;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--benchmark-kernels") {
+        benchmarkDomainKernels();
+        return 0;
+    }
+
     XMLNode xMainNode = XMLNode::openFileHelper("samples.xml", "samples");
     int numSamples = xMainNode.nChildNode();
     int numIterations = 2;
 
     microseconds inputTime{0}, synthesisTime{0}, outputTime{0};
+    int successes = 0;
     for (int i = 0; i < numSamples; i++) {
         InputSettings* settings = parseInput(xMainNode.getChildNode(i), inputTime);
+        if (settings->batchSize > 0) {
+            // The models are synthesized in parallel but written one at a time,
+            // since every tiled model rewrites outputs/latest.txt.
+            mutex outputMutex;
+            BatchGenerator batch(settings, settings->numThreads);
+            batch.generate(settings->batchSize, [&](int index, uint64_t, const LabelGrid& model) {
+                lock_guard<mutex> lock(outputMutex);
+                cout << settings->name << " " << index << endl;
+                generateOutput(*settings, model, outputPath(*settings, i, index), outputTime);
+            }, synthesisTime);
+            successes += settings->batchSize;
+            delete settings;
+            continue;
+        }
+
         Synthesizer synthesizer(settings, synthesisTime);
         for (int iteration = 0; iteration < numIterations; iteration++) {
             cout << settings->name << " " << iteration << endl;
             synthesizer.synthesize(synthesisTime);
-
-            string outputPath;
-            if (settings->type == "simpletiled" || settings->type == "overlapping") {
-                string extra = (i + 1) < 10 ? "0" : "";
-                outputPath = "outputs/" + extra + to_string(i + 1) + " " + settings->name + " " + settings->subset + " " + to_string(iteration) + ".png";
-            } else {
-                outputPath = "outputs/" + to_string(i + 1) + " " + to_string(iteration) + " " + settings->name;
+            generateOutput(*settings, synthesizer.getModel(), outputPath(*settings, i, iteration), outputTime);
+        }
+        if (settings->adaptiveBlocks) {
+            cout << "Block sizes:" << endl;
+            for (const auto& entry : synthesizer.getBlockSizeCounts()) {
+                const array<int, 3>& blockSize = entry.first;
+                cout << "  " << blockSize[0] << " x " << blockSize[1] << " x " << blockSize[2] << ": " << entry.second << " blocks" << endl;
             }
-            generateOutput(*settings, synthesizer.getModel(), outputPath, outputTime);
         }
+        successes += numIterations;
         delete settings;
     }
 
@@ -46,7 +79,6 @@ int main() {
     cout << "Output: " << outputTimeMs << " ms" << endl;
     cout << "Total: " << totalTimeMs << " ms" << endl << endl;
 
-    const int successes = numSamples * numIterations;
     cout << "Per Success" << endl;
     cout << "Synthesize: " << synthesisTimeMs / successes << " ms" << endl;
     cout << "Output: " << outputTimeMs / successes << " ms" << endl;
@@ -0,0 +1,45 @@
+// Copyright (c) 2021 Paul Merrell
+#include "BatchGenerator.h"
+#include "Random.h"
+
+using namespace std;
+using namespace std::chrono;
+
+BatchGenerator::BatchGenerator(InputSettings* newSettings, int numThreads) {
+	settings = newSettings;
+	threadPool = new ThreadPool(numThreads);
+	microseconds setupTime{0};
+	for (int i = 0; i < threadPool->getNumThreads(); i++) {
+		synthesizers.push_back(new Synthesizer(settings, setupTime, true));
+	}
+}
+
+BatchGenerator::~BatchGenerator() {
+	delete threadPool;
+	for (Synthesizer* synthesizer : synthesizers) {
+		delete synthesizer;
+	}
+}
+
+void BatchGenerator::generate(const vector<uint64_t>& seeds, const OutputSink& sink, microseconds& synthesisTime) {
+	// Each thread adds up its own time, so the time spent in the sink is not
+	// counted.
+	vector<microseconds> workerTimes(synthesizers.size(), microseconds{0});
+	threadPool->parallelFor((int)seeds.size(), [&](int i, int worker) {
+		Synthesizer& synthesizer = *synthesizers[worker];
+		synthesizer.setSeed(seeds[i]);
+		synthesizer.synthesize(workerTimes[worker]);
+		sink(i, seeds[i], synthesizer.getModel());
+	});
+	for (const microseconds& workerTime : workerTimes) {
+		synthesisTime += workerTime;
+	}
+}
+
+void BatchGenerator::generate(int count, const OutputSink& sink, microseconds& synthesisTime) {
+	vector<uint64_t> seeds;
+	for (int i = 0; i < count; i++) {
+		seeds.push_back(Random::mix(settings->seed, i));
+	}
+	generate(seeds, sink, synthesisTime);
+}
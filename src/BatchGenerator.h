@@ -0,0 +1,48 @@
+// Copyright (c) 2021 Paul Merrell
+#ifndef BATCH_GENERATOR
+#define BATCH_GENERATOR
+
+#include "parseInput/parseInput.h"
+#include "synthesizer.h"
+#include "ThreadPool.h"
+#include "LabelGrid.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Receives each model in a batch as soon as it is synthesized, with its
+// index in the batch and its seed. It is called from the batch's threads, so
+// it must be safe to call from several threads at once.
+typedef std::function<void(int index, uint64_t seed, const LabelGrid& model)> OutputSink;
+
+// Synthesizes many models from the same settings in parallel. Each thread
+// has its own synthesizer and takes the next model in the batch whenever it
+// finishes one. The settings are only read, so they are shared by every
+// thread. Each model depends only on its seed, so the models are the same
+// for any number of threads.
+class BatchGenerator {
+	private:
+		InputSettings* settings;
+		ThreadPool* threadPool;
+		// The synthesizer for each thread.
+		std::vector<Synthesizer*> synthesizers;
+
+	public:
+		// 0 threads uses one thread per core.
+		BatchGenerator(InputSettings* newSettings, int numThreads);
+		~BatchGenerator();
+
+		// Synthesize one model for each seed and hand it to the sink. The
+		// model synthesized from a seed is the same as the first model from a
+		// synthesizer whose settings have that seed. The time to synthesize
+		// each model, but not the time in the sink, is added to
+		// synthesisTime, so it is the total over every thread.
+		void generate(const std::vector<uint64_t>& seeds, const OutputSink& sink, std::chrono::microseconds& synthesisTime);
+
+		// Synthesize the given number of models, each with a seed derived
+		// from the seed in the settings.
+		void generate(int count, const OutputSink& sink, std::chrono::microseconds& synthesisTime);
+};
+
+#endif // BATCH_GENERATOR
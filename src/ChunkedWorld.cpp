@@ -0,0 +1,209 @@
+// Copyright (c) 2021 Paul Merrell
+#include "ChunkedWorld.h"
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+const int numAttempts = 20;
+
+ChunkedWorld::ChunkedWorld(InputSettings* newSettings, size_t newMaxCachedChunks, const string& newSpillDirectory) {
+	settings = newSettings;
+	numLabels = settings->numLabels;
+	maxCachedChunks = max(newMaxCachedChunks, (size_t)1);
+	spillDirectory = newSpillDirectory;
+	if (settings->periodic) {
+		cout << "ERROR: Chunked worlds can not be periodic." << endl;
+	}
+
+	chunkSize[0] = settings->blockSize[0];
+	chunkSize[1] = settings->blockSize[1];
+	chunkSize[2] = settings->size[2];
+	for (int dim = 0; dim < 2; dim++) {
+		offset[dim] = 1;
+		possibilitySize[dim] = chunkSize[dim] + 2;
+	}
+	offset[2] = 0;
+	possibilitySize[2] = chunkSize[2];
+	state.propagator = createPropagator(settings, possibilitySize, offset);
+	state.pickedBlock = new LabelGrid(possibilitySize, numLabels);
+	for (int dim = 0; dim < 3; dim++) {
+		state.blockSize[dim] = chunkSize[dim];
+	}
+	state.canSplit = false;
+	state.hasSnapshot = false;
+	state.firstSuccess = nullptr;
+	state.attempt = 0;
+}
+
+ChunkedWorld::~ChunkedWorld() {
+	for (auto& entry : cache) {
+		delete entry.second.labels;
+	}
+	delete state.pickedBlock;
+	delete state.propagator;
+}
+
+int64_t ChunkedWorld::key(int cx, int cy) {
+	return (int64_t)(((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy);
+}
+
+string ChunkedWorld::spillPath(int cx, int cy) const {
+	return spillDirectory + "/chunk " + to_string(cx) + " " + to_string(cy) + ".bin";
+}
+
+LabelGrid* ChunkedWorld::findChunk(int cx, int cy) {
+	int64_t chunkKey = key(cx, cy);
+	auto found = cache.find(chunkKey);
+	if (found != cache.end()) {
+		recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, found->second.recent);
+		return found->second.labels;
+	}
+	if (spilled.count(chunkKey) == 0) {
+		return nullptr;
+	}
+
+	LabelGrid* labels = new LabelGrid(chunkSize, numLabels);
+	ifstream infile(spillPath(cx, cy), ios::in | ios::binary);
+	infile.read((char*)labels->getData(), labels->getNumBytes());
+	if (!infile) {
+		cout << "ERROR: Could not read chunk " << cx << " " << cy << " from the spill directory." << endl;
+		delete labels;
+		spilled.erase(chunkKey);
+		return nullptr;
+	}
+	insertChunk(cx, cy, labels);
+	return labels;
+}
+
+void ChunkedWorld::insertChunk(int cx, int cy, LabelGrid* labels) {
+	while (cache.size() >= maxCachedChunks) {
+		evictChunk();
+	}
+	int64_t chunkKey = key(cx, cy);
+	recentlyUsed.push_front(chunkKey);
+	cache[chunkKey] = { labels, recentlyUsed.begin() };
+}
+
+void ChunkedWorld::evictChunk() {
+	int64_t chunkKey = recentlyUsed.back();
+	recentlyUsed.pop_back();
+	LabelGrid* labels = cache[chunkKey].labels;
+	cache.erase(chunkKey);
+
+	if (!spillDirectory.empty() && spilled.count(chunkKey) == 0) {
+		int cx = (int)(chunkKey >> 32);
+		int cy = (int)(uint32_t)chunkKey;
+		ofstream outfile(spillPath(cx, cy), ios::out | ios::binary);
+		outfile.write((const char*)labels->getData(), labels->getNumBytes());
+		if (outfile) {
+			spilled.insert(chunkKey);
+		} else {
+			cout << "ERROR: Could not write chunk " << cx << " " << cy << " to the spill directory." << endl;
+		}
+	}
+	delete labels;
+}
+
+const LabelGrid* ChunkedWorld::getChunk(int cx, int cy) {
+	LabelGrid* labels = findChunk(cx, cy);
+	if (labels != nullptr) {
+		return labels;
+	}
+
+	// Copy the labels next to the chunk out of each neighbor right away,
+	// since finding the next neighbor may evict it.
+	const int neighborOffsets[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+	LabelGrid* sides[4];
+	for (int dir = 0; dir < 4; dir++) {
+		int dim = dir / 2;
+		int sideSize[3] = { chunkSize[0], chunkSize[1], chunkSize[2] };
+		sideSize[dim] = 1;
+		sides[dir] = new LabelGrid(sideSize, numLabels);
+		LabelGrid* neighbor = findChunk(cx + neighborOffsets[dir][0], cy + neighborOffsets[dir][1]);
+		if (neighbor == nullptr) {
+			// Like the cells of a model before its blocks are synthesized,
+			// a missing chunk has the initial labels, which tile the plane.
+			// This keeps the chunk compatible with any neighbors that are
+			// later synthesized on this side.
+			sides[dir]->fillAlongZ(settings->initialLabels);
+			continue;
+		}
+		// The neighbor's cells on the side facing this chunk.
+		int sourceStart[3] = { 0, 0, 0 };
+		sourceStart[dim] = (dir % 2) ? 0 : chunkSize[dim] - 1;
+		int start[3] = { 0, 0, 0 };
+		sides[dir]->copyBlock(*neighbor, sourceStart, start, sideSize);
+	}
+
+	labels = new LabelGrid(chunkSize, numLabels);
+	bool success = synthesizeChunk(cx, cy, sides, *labels);
+	for (int dir = 0; dir < 4; dir++) {
+		delete sides[dir];
+	}
+	if (!success) {
+		delete labels;
+		return nullptr;
+	}
+	insertChunk(cx, cy, labels);
+	return labels;
+}
+
+bool ChunkedWorld::synthesizeChunk(int cx, int cy, LabelGrid* const sides[4], LabelGrid& labels) {
+	uint64_t chunkSeed = Random::mix(Random::mix(settings->seed, (uint64_t)cx), (uint64_t)cy);
+	for (int attempt = 0; attempt < numAttempts; attempt++) {
+		state.random.setSeed(attempt == 0 ? chunkSeed : Random::mix(chunkSeed, attempt));
+		if (synthesizeAttempt(sides)) {
+			int start[3] = { 0, 0, 0 };
+			labels.copyBlock(*state.pickedBlock, offset, start, chunkSize);
+			return true;
+		}
+		if (attempt + 1 < numAttempts) {
+			cout << "  Failed. Retrying..." << endl;
+		} else {
+			cout << "  Failed. Max Attempts." << endl;
+		}
+	}
+	return false;
+}
+
+bool ChunkedWorld::synthesizeAttempt(LabelGrid* const sides[4]) {
+	Propagator* propagator = state.propagator;
+	propagator->resetBlock();
+	for (int dir = 0; dir < 4; dir++) {
+		// The side fills the ring on this side of the chunk.
+		int dim = dir / 2;
+		int planePos = (dir % 2) ? chunkSize[dim] + 1 : 0;
+		int labelStart[2] = { 0, 0 };
+		if (!Synthesizer::setPlane(propagator, dim, planePos, chunkSize, offset, sides[dir]->slab(dim, 0), labelStart)) {
+			return false;
+		}
+	}
+
+	// In 3D the bottom and top layers keep their initial labels, as they do
+	// when synthesizing a model.
+	if (chunkSize[2] > 1) {
+		int position[3];
+		for (int x = offset[0]; x < chunkSize[0] + offset[0]; x++) {
+			position[0] = x;
+			for (int y = offset[1]; y < chunkSize[1] + offset[1]; y++) {
+				position[1] = y;
+				position[2] = 0;
+				if (!propagator->setBlockLabel(settings->initialLabels[0], position)) {
+					return false;
+				}
+				position[2] = chunkSize[2] - 1;
+				if (!propagator->setBlockLabel(settings->initialLabels[chunkSize[2] - 1], position)) {
+					return false;
+				}
+			}
+		}
+	}
+
+	// Only the bottom and top of the world are edges.
+	const bool onEdge[6] = { false, false, false, false, true, true };
+	if (settings->useAc4 && !Synthesizer::removeNoSupport(*settings, propagator, chunkSize, offset, onEdge)) {
+		return false;
+	}
+	return Synthesizer::pickLabels(state, offset);
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2021 Paul Merrell
+#ifndef CHUNKED_WORLD
+#define CHUNKED_WORLD
+
+#include "parseInput/parseInput.h"
+#include "synthesizer.h"
+#include "LabelGrid.h"
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// A world without edges in x and y that is synthesized one chunk at a time,
+// when each chunk is first asked for. A chunk is one block of the block size
+// in the settings and the full height of the model. A new chunk takes the
+// labels next to it from the neighboring chunks that already exist, and the
+// initial labels on the sides where there are none yet, so the chunks fit
+// together in whatever order they are asked for. There is no ground plane
+// since the world has no bottom edge in y.
+//
+// Only the most recently used chunks are kept in memory. The others are
+// written to the spill directory if there is one and read back when they are
+// needed again. Without one they are dropped, and a dropped chunk is
+// synthesized again, possibly differently, the next time it is asked for.
+class ChunkedWorld {
+	private:
+		struct CachedChunk {
+			LabelGrid* labels;
+			// The chunk's place in recentlyUsed.
+			std::list<int64_t>::iterator recent;
+		};
+
+		InputSettings* settings;
+		int chunkSize[3];
+		int numLabels;
+
+		// The propagator works on the chunk plus a ring of one cell around it
+		// in x and y, which holds the labels of the neighboring chunks. The
+		// chunk is picked with the same helpers as a block of a model.
+		int possibilitySize[3];
+		int offset[3];
+		BlockState state;
+
+		// The chunks in memory, and their keys from the most to the least
+		// recently used.
+		std::unordered_map<int64_t, CachedChunk> cache;
+		std::list<int64_t> recentlyUsed;
+		size_t maxCachedChunks;
+
+		// Where chunks are written when they leave the cache. Chunks never
+		// change, so each is only written once.
+		std::string spillDirectory;
+		std::unordered_set<int64_t> spilled;
+
+		static int64_t key(int cx, int cy);
+		std::string spillPath(int cx, int cy) const;
+
+		// Find a chunk in memory or in the spill directory and mark it as the
+		// most recently used. Returns null if it has not been synthesized.
+		LabelGrid* findChunk(int cx, int cy);
+
+		// Add a chunk to the cache, evicting the least recently used chunks
+		// if the cache is full.
+		void insertChunk(int cx, int cy, LabelGrid* labels);
+		void evictChunk();
+
+		// Synthesize the chunk, retrying with a new seed when an attempt
+		// fails. sides holds the labels next to the chunk in the -X, +X, -Y,
+		// +Y directions, each one cell thick.
+		bool synthesizeChunk(int cx, int cy, LabelGrid* const sides[4], LabelGrid& labels);
+		bool synthesizeAttempt(LabelGrid* const sides[4]);
+
+	public:
+		ChunkedWorld(InputSettings* newSettings, size_t newMaxCachedChunks, const std::string& newSpillDirectory = "");
+		~ChunkedWorld();
+
+		// The labels in chunk (cx, cy), synthesizing it if it does not exist.
+		// Returns null if every attempt at the chunk failed. The chunk stays
+		// valid until the next call.
+		const LabelGrid* getChunk(int cx, int cy);
+
+		const int* getChunkSize() const { return chunkSize; }
+};
+
+#endif // CHUNKED_WORLD
@@ -0,0 +1,197 @@
+// Copyright (c) 2021 Paul Merrell
+#include "LabelGrid.h"
+#include <cstring>
+#include <iostream>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// The handles for a file mapped into memory.
+struct MappedFile {
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int file;
+#endif
+	size_t numBytes;
+};
+
+// Create or overwrite the file with the given number of bytes and map it for
+// reading and writing. Returns null if the file could not be mapped.
+static uint8_t* mapFile(const string& path, size_t numBytes, MappedFile*& mapped) {
+	mapped = new MappedFile();
+	mapped->numBytes = numBytes;
+	void* view = nullptr;
+#ifdef _WIN32
+	mapped->file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	mapped->mapping = NULL;
+	if (mapped->file != INVALID_HANDLE_VALUE) {
+		mapped->mapping = CreateFileMappingA(mapped->file, NULL, PAGE_READWRITE,
+			(DWORD)((uint64_t)numBytes >> 32), (DWORD)numBytes, NULL);
+	}
+	if (mapped->mapping != NULL) {
+		view = MapViewOfFile(mapped->mapping, FILE_MAP_ALL_ACCESS, 0, 0, numBytes);
+	}
+	if (view == nullptr) {
+		if (mapped->mapping != NULL) {
+			CloseHandle(mapped->mapping);
+		}
+		if (mapped->file != INVALID_HANDLE_VALUE) {
+			CloseHandle(mapped->file);
+		}
+	}
+#else
+	mapped->file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (mapped->file >= 0 && ftruncate(mapped->file, (off_t)numBytes) == 0) {
+		view = mmap(nullptr, numBytes, PROT_READ | PROT_WRITE, MAP_SHARED, mapped->file, 0);
+		if (view == MAP_FAILED) {
+			view = nullptr;
+		}
+	}
+	if (view == nullptr && mapped->file >= 0) {
+		close(mapped->file);
+	}
+#endif
+	if (view == nullptr) {
+		delete mapped;
+		mapped = nullptr;
+	}
+	return (uint8_t*)view;
+}
+
+static void unmapFile(uint8_t* data, MappedFile* mapped) {
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle(mapped->mapping);
+	CloseHandle(mapped->file);
+#else
+	munmap(data, mapped->numBytes);
+	close(mapped->file);
+#endif
+	delete mapped;
+}
+
+// The axes for each order, from the slowest changing to the fastest.
+static const int axisOrders[6][3] = {
+	{ 0, 1, 2 },
+	{ 0, 2, 1 },
+	{ 1, 0, 2 },
+	{ 1, 2, 0 },
+	{ 2, 0, 1 },
+	{ 2, 1, 0 }
+};
+
+LabelGrid::LabelGrid(const int* newSize, int numLabels, AxisOrder newOrder, const string& path) {
+	order = newOrder;
+	for (int dim = 0; dim < 3; dim++) {
+		size[dim] = newSize[dim];
+	}
+
+	// Use the narrowest type that can hold every label.
+	if (numLabels <= UINT8_MAX + 1) {
+		width = sizeof(uint8_t);
+	} else if (numLabels <= UINT16_MAX + 1) {
+		width = sizeof(uint16_t);
+	} else {
+		width = sizeof(uint32_t);
+	}
+
+	const int* axes = axisOrders[(int)order];
+	fastestAxis = axes[2];
+	size_t stride = 1;
+	for (int i = 2; i >= 0; i--) {
+		strides[axes[i]] = stride;
+		stride *= size[axes[i]];
+	}
+
+	file = nullptr;
+	data = nullptr;
+	if (!path.empty()) {
+		data = mapFile(path, stride * width, file);
+		if (data == nullptr) {
+			cout << "ERROR: Could not map the model file " << path << ". The model is kept in memory instead." << endl;
+		}
+	}
+	if (data == nullptr) {
+		data = new uint8_t[stride * width];
+	}
+}
+
+LabelGrid::~LabelGrid() {
+	if (file != nullptr) {
+		unmapFile(data, file);
+	} else {
+		delete[] data;
+	}
+}
+
+LabelRow LabelGrid::row(int axis, const int position[3]) const {
+	int start[3] = { position[0], position[1], position[2] };
+	start[axis] = 0;
+	const uint8_t* first = data + index(start[0], start[1], start[2]) * width;
+	return LabelRow(first, strides[axis], width, size[axis]);
+}
+
+LabelSlab LabelGrid::slab(int axis, int value) const {
+	size_t slabStrides[2];
+	int extents[2];
+	int i = 0;
+	for (int dim = 0; dim < 3; dim++) {
+		if (dim != axis) {
+			slabStrides[i] = strides[dim];
+			extents[i] = size[dim];
+			i++;
+		}
+	}
+	const uint8_t* first = data + value * strides[axis] * width;
+	return LabelSlab(first, slabStrides, width, extents);
+}
+
+void LabelGrid::fillAlongZ(const int* labels) {
+	for (int x = 0; x < size[0]; x++) {
+		for (int y = 0; y < size[1]; y++) {
+			for (int z = 0; z < size[2]; z++) {
+				set(x, y, z, labels[z]);
+			}
+		}
+	}
+}
+
+void LabelGrid::copyBlock(const LabelGrid& source, const int sourceStart[3], const int start[3], const int extent[3]) {
+	if (source.order != order || source.width != width) {
+		for (int x = 0; x < extent[0]; x++) {
+			for (int y = 0; y < extent[1]; y++) {
+				for (int z = 0; z < extent[2]; z++) {
+					set(x + start[0], y + start[1], z + start[2],
+						source.get(x + sourceStart[0], y + sourceStart[1], z + sourceStart[2]));
+				}
+			}
+		}
+		return;
+	}
+
+	const int* axes = axisOrders[(int)order];
+	size_t runBytes = (size_t)extent[fastestAxis] * width;
+	int from[3] = { sourceStart[0], sourceStart[1], sourceStart[2] };
+	int to[3] = { start[0], start[1], start[2] };
+	for (int i = 0; i < extent[axes[0]]; i++) {
+		from[axes[0]] = sourceStart[axes[0]] + i;
+		to[axes[0]] = start[axes[0]] + i;
+		for (int j = 0; j < extent[axes[1]]; j++) {
+			from[axes[1]] = sourceStart[axes[1]] + j;
+			to[axes[1]] = start[axes[1]] + j;
+			memcpy(data + index(to[0], to[1], to[2]) * width,
+				source.data + source.index(from[0], from[1], from[2]) * width,
+				runBytes);
+		}
+	}
+}
@@ -0,0 +1,156 @@
+// Copyright (c) 2021 Paul Merrell
+#ifndef LABEL_GRID
+#define LABEL_GRID
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// The order the axes are stored in, from the slowest changing to the fastest.
+// With XYZ, the labels along z are next to each other in memory.
+enum class AxisOrder { XYZ, XZY, YXZ, YZX, ZXY, ZYX };
+
+// Reads a label of the given width in bytes.
+inline int readLabel(const uint8_t* data, int width, size_t i) {
+	switch (width) {
+		case sizeof(uint8_t): return data[i];
+		case sizeof(uint16_t): return ((const uint16_t*)data)[i];
+		default: return (int)((const uint32_t*)data)[i];
+	}
+}
+
+// The labels along one axis of a grid.
+class LabelRow {
+	private:
+		const uint8_t* data;
+		size_t stride;
+		int width;
+		int length;
+
+	public:
+		LabelRow(const uint8_t* newData, size_t newStride, int newWidth, int newLength) :
+			data(newData), stride(newStride), width(newWidth), length(newLength) {}
+
+		inline int operator[](int i) const {
+			return readLabel(data, width, i * stride);
+		}
+
+		int getLength() const { return length; }
+
+		// Whether the labels are next to each other in memory.
+		bool isContiguous() const { return stride == 1; }
+};
+
+// The labels in the plane where one axis has a fixed value. The plane's two
+// axes are the other two axes, in x, y, z order.
+class LabelSlab {
+	private:
+		const uint8_t* data;
+		size_t strides[2];
+		int width;
+		int extents[2];
+
+	public:
+		LabelSlab(const uint8_t* newData, const size_t newStrides[2], int newWidth, const int newExtents[2]) :
+			data(newData), width(newWidth) {
+			strides[0] = newStrides[0];
+			strides[1] = newStrides[1];
+			extents[0] = newExtents[0];
+			extents[1] = newExtents[1];
+		}
+
+		inline int at(int i, int j) const {
+			return readLabel(data, width, i * strides[0] + j * strides[1]);
+		}
+
+		// The labels along the plane's second axis at i on its first axis.
+		LabelRow row(int i) const {
+			return LabelRow(data + i * strides[0] * width, strides[1], width, extents[1]);
+		}
+
+		int getExtent(int axis) const { return extents[axis]; }
+};
+
+struct MappedFile;
+
+// Stores one label for every cell of a 3D grid in one contiguous allocation.
+// Each label takes one, two or four bytes, the fewest that can hold every
+// label.
+//
+// The labels can also be kept in a file that is mapped into memory, so the
+// grid can be larger than memory. The operating system then keeps only the
+// recently used parts resident. With the XYZ order, the cells a block reads
+// and writes lie in the few x-slabs it covers, so sweeping the blocks along
+// x touches the file in order.
+class LabelGrid {
+	private:
+		uint8_t* data;
+		// The file the labels are mapped from, or null if they are in memory.
+		MappedFile* file;
+		int size[3];
+		// How far apart, in labels, neighboring cells along each axis are.
+		size_t strides[3];
+		AxisOrder order;
+		// The axis that is stored contiguously.
+		int fastestAxis;
+		int width;
+
+		inline size_t index(int x, int y, int z) const {
+			return x * strides[0] + y * strides[1] + z * strides[2];
+		}
+
+	public:
+		// The labels are kept in memory unless a path is given, in which case
+		// the file is created or overwritten and mapped.
+		LabelGrid(const int* newSize, int numLabels, AxisOrder newOrder = AxisOrder::XYZ, const std::string& path = "");
+		~LabelGrid();
+
+		// The grid owns its labels or its mapped file, so copying it would
+		// free them twice. Use copyBlock to copy the labels instead.
+		LabelGrid(const LabelGrid&) = delete;
+		LabelGrid& operator=(const LabelGrid&) = delete;
+
+		inline int get(int x, int y, int z) const {
+			return readLabel(data, width, index(x, y, z));
+		}
+
+		inline int get(const int position[3]) const {
+			return get(position[0], position[1], position[2]);
+		}
+
+		inline void set(int x, int y, int z, int label) {
+			size_t i = index(x, y, z);
+			switch (width) {
+				case sizeof(uint8_t): data[i] = (uint8_t)label; break;
+				case sizeof(uint16_t): ((uint16_t*)data)[i] = (uint16_t)label; break;
+				default: ((uint32_t*)data)[i] = (uint32_t)label; break;
+			}
+		}
+
+		// The labels along the axis through the position. The position's
+		// value on that axis is ignored.
+		LabelRow row(int axis, const int position[3]) const;
+
+		// The labels in the plane where the axis has the given value.
+		LabelSlab slab(int axis, int value) const;
+
+		// Set every cell to the label for its z value.
+		void fillAlongZ(const int* labels);
+
+		// Copy a box of labels from the source grid. When the source has the
+		// same axis order and label width, each run along the fastest axis is
+		// copied with one memcpy.
+		void copyBlock(const LabelGrid& source, const int sourceStart[3], const int start[3], const int extent[3]);
+
+		// The labels as stored, for reading and writing them in bulk.
+		uint8_t* getData() { return data; }
+		const uint8_t* getData() const { return data; }
+		size_t getNumBytes() const { return (size_t)size[0] * size[1] * size[2] * width; }
+
+		const int* getSize() const { return size; }
+		AxisOrder getOrder() const { return order; }
+		int getWidth() const { return width; }
+		bool isMapped() const { return file != nullptr; }
+};
+
+#endif // LABEL_GRID
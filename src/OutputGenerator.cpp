@@ -8,19 +8,21 @@
 using namespace std;
 using namespace std::chrono;
 
-void generateSimpleTiled(const InputSettings& settings, int*** model, const string outputPath) {
+void generateSimpleTiled(const InputSettings& settings, const LabelGrid& model, const string outputPath) {
 	const int* size = settings.size;
 	int tileWidth = settings.tileWidth;
 	int tileHeight = settings.tileHeight;
 	int fullWidth = size[0] * tileWidth;
 	int fullHeight = size[1] * tileHeight;
 	std::vector<unsigned char> image;
-	image.resize(4 * fullWidth * fullHeight);
+	image.resize((size_t)4 * fullWidth * fullHeight);
+	LabelSlab labels = model.slab(2, 0);
 	for (int x = 0; x < size[0]; x++) {
+		LabelRow column = labels.row(x);
 		for (int y = 0; y < size[1]; y++) {
-			const vector<unsigned char> tile = settings.tileImages[model[x][y][0]];
+			const vector<unsigned char>& tile = settings.tileImages[column[y]];
 			for (int yt = 0; yt < tileHeight; yt++) {
-				int imageOffset = x * 4 * tileWidth + 4 * (y * tileHeight + yt) * fullWidth;
+				size_t imageOffset = (size_t)x * 4 * tileWidth + (size_t)4 * (y * tileHeight + yt) * fullWidth;
 				int tileOffset = yt * 4 * tileWidth;
 				for (int xt = 0; xt < 4 * tileWidth; xt++) {
 					image[imageOffset + xt] = tile[tileOffset + xt];
@@ -35,19 +37,21 @@ void generateSimpleTiled(const InputSettings& settings, int*** model, const stri
 	if (error) std::cout << "encoder error " << error << ": " << lodepng_error_text(error) << std::endl;
 }
 
-void generateOverlapping(const InputSettings& settings, int*** model, const string outputPath) {
+void generateOverlapping(const InputSettings& settings, const LabelGrid& model, const string outputPath) {
 	const int* size = settings.size;
 	int w = size[0];
 	int h = size[1];
 	std::vector<unsigned char> image;
-	image.resize(4 * w * h);
+	image.resize((size_t)4 * w * h);
+	LabelSlab labels = model.slab(2, 0);
 	for (int x = 0; x < w; x++) {
+		LabelRow column = labels.row(x);
 		for (int y = 0; y < h; y++) {
-			const vector<unsigned char> tile = settings.tileImages[model[x][y][0]];
+			const vector<unsigned char>& tile = settings.tileImages[column[y]];
 			for (int k = 0; k < 3; k++) {
-				image[4 * (x + y * w) + k] = tile[k];
+				image[4 * ((size_t)x + (size_t)y * w) + k] = tile[k];
 			}
-			image[4 * (x + y * w) + 3] = 255;
+			image[4 * ((size_t)x + (size_t)y * w) + 3] = 255;
 		}
 	}
 
@@ -58,7 +62,7 @@ void generateOverlapping(const InputSettings& settings, int*** model, const stri
 	if (error) std::cout << "encoder error " << error << ": " << lodepng_error_text(error) << std::endl;
 }
 
-void generateTiledModel(const InputSettings& settings, int*** model, const string outputPath) {
+void generateTiledModel(const InputSettings& settings, const LabelGrid& model, const string outputPath) {
 	const int* size = settings.size;
 	ofstream outfile(outputPath, ios::out);
 	outfile << "Model generated using Paul Merrell's model synthesis algorithm.  Do not insert or delete lines from this file." << endl;
@@ -67,9 +71,11 @@ void generateTiledModel(const InputSettings& settings, int*** model, const strin
 	outfile << size[0] << " " << size[1] << " " << size[2] << endl << endl;
 
 	for (int z = 0; z < size[2]; z++) {
+		LabelSlab labels = model.slab(2, z);
 		for (int x = 0; x < size[0]; x++) {
+			LabelRow row = labels.row(x);
 			for (int y = 0; y < size[1]; y++) {
-				int label = model[x][y][z];
+				int label = row[y];
 				if (label < 10) {
 					outfile << " ";
 				}
@@ -90,7 +96,7 @@ void generateTiledModel(const InputSettings& settings, int*** model, const strin
 
 void generateOutput(
 	const InputSettings& settings,
-	int*** model,
+	const LabelGrid& model,
 	const std::string outputPath,
 	microseconds& outputTime) {
 	auto startTime = high_resolution_clock::now();
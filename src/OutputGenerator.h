@@ -3,12 +3,13 @@
 #define OUTPUT_GENERATOR
 
 #include "parseInput/parseInput.h"
+#include "LabelGrid.h"
 #include <string>
 #include <chrono>
 
 void generateOutput(
 	const InputSettings& settings,
-	int*** model,
+	const LabelGrid& model,
 	const std::string outputPath,
 	std::chrono::microseconds& outputTime);
 
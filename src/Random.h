@@ -0,0 +1,60 @@
+// Copyright (c) 2021 Paul Merrell
+#ifndef RANDOM
+#define RANDOM
+
+#include <cstdint>
+
+// A fast random number generator using xoshiro256** (Blackman and Vigna).
+// Each synthesizer owns its own generator, so synthesizers on different
+// threads do not share any state, and the same seed always gives the same
+// sequence of numbers on every platform.
+class Random {
+	private:
+		uint64_t state[4];
+
+		static inline uint64_t rotateLeft(uint64_t x, int k) {
+			return (x << k) | (x >> (64 - k));
+		}
+
+	public:
+		Random(uint64_t seed = 0) {
+			setSeed(seed);
+		}
+
+		// Mix a value into a seed with splitmix64. This is used to give each
+		// block or iteration its own seed derived from the model's seed.
+		static inline uint64_t mix(uint64_t seed, uint64_t value) {
+			uint64_t z = seed + 0x9E3779B97F4A7C15ULL * (value + 1);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			return z ^ (z >> 31);
+		}
+
+		// Restart the sequence from the seed. The state is filled with
+		// splitmix64 so that similar seeds give unrelated sequences.
+		void setSeed(uint64_t seed) {
+			for (int i = 0; i < 4; i++) {
+				state[i] = mix(seed, i);
+			}
+		}
+
+		// Returns the next 64 random bits.
+		inline uint64_t next() {
+			uint64_t result = rotateLeft(state[1] * 5, 7) * 9;
+			uint64_t t = state[1] << 17;
+			state[2] ^= state[0];
+			state[3] ^= state[1];
+			state[1] ^= state[2];
+			state[0] ^= state[3];
+			state[2] ^= t;
+			state[3] = rotateLeft(state[3], 45);
+			return result;
+		}
+
+		// Returns a random number in [0, 1) with 53 bits of precision.
+		inline double nextDouble() {
+			return (next() >> 11) * (1.0 / 9007199254740992.0);
+		}
+};
+
+#endif // RANDOM
@@ -0,0 +1,83 @@
+// Copyright (c) 2021 Paul Merrell
+#include "ThreadPool.h"
+#include <algorithm>
+
+using namespace std;
+
+ThreadPool::ThreadPool(int numThreads) {
+	if (numThreads <= 0) {
+		numThreads = defaultNumThreads();
+	}
+	job = nullptr;
+	count = 0;
+	next = 0;
+	active = 0;
+	generation = 0;
+	stopping = false;
+	for (int i = 0; i < numThreads; i++) {
+		threads.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	for (thread& t : threads) {
+		t.join();
+	}
+}
+
+int ThreadPool::defaultNumThreads() {
+	return max((int)thread::hardware_concurrency(), 1);
+}
+
+// Wait for a loop to start, then take iterations until there are none left.
+void ThreadPool::workerLoop(int worker) {
+	int seenGeneration = 0;
+	while (true) {
+		unique_lock<std::mutex> lock(mutex);
+		wakeUp.wait(lock, [&] { return stopping || generation != seenGeneration; });
+		if (stopping) {
+			return;
+		}
+		seenGeneration = generation;
+		const function<void(int, int)>& function = *job;
+		int loopCount = count;
+		lock.unlock();
+
+		while (true) {
+			int index = next.fetch_add(1);
+			if (index >= loopCount) {
+				break;
+			}
+			function(index, worker);
+		}
+
+		lock.lock();
+		active--;
+		if (active == 0) {
+			finished.notify_all();
+		}
+	}
+}
+
+void ThreadPool::parallelFor(int newCount, const function<void(int, int)>& function) {
+	if (newCount <= 0) {
+		return;
+	}
+	unique_lock<std::mutex> lock(mutex);
+	job = &function;
+	count = newCount;
+	next = 0;
+	active = (int)threads.size();
+	generation++;
+	lock.unlock();
+	wakeUp.notify_all();
+
+	lock.lock();
+	finished.wait(lock, [&] { return active == 0; });
+	job = nullptr;
+}
@@ -0,0 +1,49 @@
+// Copyright (c) 2021 Paul Merrell
+#ifndef THREAD_POOL
+#define THREAD_POOL
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// A fixed set of worker threads that run the iterations of a loop in
+// parallel. The threads are created once and reused by every loop.
+class ThreadPool {
+	private:
+		std::vector<std::thread> threads;
+		std::mutex mutex;
+		// Signals the workers that a new loop has started or that they should
+		// stop, and signals the caller that every worker has finished.
+		std::condition_variable wakeUp;
+		std::condition_variable finished;
+
+		// The loop being run. generation changes every time a loop starts.
+		const std::function<void(int, int)>* job;
+		int count;
+		std::atomic<int> next;
+		int active;
+		int generation;
+		bool stopping;
+
+		void workerLoop(int worker);
+
+	public:
+		// Create the pool. A numThreads of 0 uses one thread per core.
+		ThreadPool(int numThreads);
+		~ThreadPool();
+
+		int getNumThreads() const { return (int)threads.size(); }
+
+		// Call function(index, worker) for every index from 0 to count - 1.
+		// worker is the index of the thread running the call, so each thread
+		// can use its own state. Returns once every call has finished.
+		void parallelFor(int count, const std::function<void(int, int)>& function);
+
+		// The number of threads a numThreads of 0 stands for.
+		static int defaultNumThreads();
+};
+
+#endif // THREAD_POOL
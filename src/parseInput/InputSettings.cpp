@@ -74,6 +74,40 @@ void findInitialLabel(InputSettings& settings) {
 	}
 }
 
+// Find the fewest labels that lead from the initial label down to the ground.
+void findGroundLabels(InputSettings& settings) {
+	bool*** transition = settings.transition;
+	int numLabels = settings.numLabels;
+	// Search up from the ground through the labels that tile along x. below
+	// is the label each one was reached from.
+	vector<int> below(numLabels, -1);
+	vector<bool> reached(numLabels, false);
+	vector<int> queue = { settings.ground };
+	reached[settings.ground] = true;
+	for (size_t i = 0; i < queue.size(); i++) {
+		int label = queue[i];
+		if (transition[1][settings.initialLabels[0]][label]) {
+			settings.groundLabels.clear();
+			for (int each = label; each != -1; each = below[each]) {
+				settings.groundLabels.push_back(each);
+			}
+			return;
+		}
+		for (int above = 0; above < numLabels; above++) {
+			if (!reached[above] && transition[0][above][above] && transition[1][above][label]) {
+				reached[above] = true;
+				below[above] = label;
+				queue.push_back(above);
+			}
+		}
+	}
+	settings.groundLabels = { settings.ground };
+	bool modifyInBlocks = (settings.blockSize[0] < settings.size[0] || settings.blockSize[1] < settings.size[1]);
+	if (modifyInBlocks) {
+		cout << "The ground plane does not fit below the initial label. The blocks along the ground may fail.\n" << endl;
+	}
+}
+
 // Return the index for an RGB image.
 int rgb(int x, int y, int N) {
 	return 3 * (x + y * N);
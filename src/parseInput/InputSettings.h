@@ -16,6 +16,48 @@ struct InputSettings {
 	// Whether to use the AC-4 algorithm instead of AC-3.
 	bool useAc4 = true;
 
+	// Whether to use the AC-2001 algorithm instead of AC-3. This is only
+	// used if useAc4 is false. Like AC-4 it keeps an entry for every cell,
+	// label and direction, so it does not change how memory grows. Each
+	// entry takes 1 byte and is not copied for snapshots, so it uses half of
+	// AC-4's memory for them, or a quarter once a label has more than 255
+	// supports.
+	bool useAc2001 = false;
+
+	// Whether to use the compact-table propagator instead of AC-3. This is
+	// only used if useAc4 is false.
+	bool useCompactTable = false;
+
+	// How many picks the synthesizer may undo when a block fails before
+	// starting the block over. 0 disables backtracking.
+	int backtrackDepth = 0;
+
+	// The seed for the random number generator. Each block is synthesized
+	// with its own seed derived from this, so the same seed always gives the
+	// same output.
+	uint64_t seed = 0;
+
+	// The number of threads to synthesize blocks on. With more than one,
+	// blocks that do not overlap are synthesized at the same time, in an
+	// order that gives the same output as one thread. Adaptive blocks are
+	// always synthesized one at a time. 0 uses one thread per core.
+	int numThreads = 1;
+
+	// How many attempts at a block to run at the same time when the blocks
+	// are synthesized one at a time. Each attempt has its own seed, so the
+	// output is the same as running the attempts one after another.
+	int speculativeAttempts = 1;
+
+	// The number of models to synthesize in parallel, each from its own
+	// seed, instead of synthesizing the usual iterations one at a time. The
+	// batch runs on numThreads threads. 0 synthesizes the usual iterations.
+	int batchSize = 0;
+
+	// The file to keep the model in, mapped into memory so that only the
+	// parts near the blocks being synthesized need to be resident. The
+	// model is kept in memory if this is empty.
+	string modelFile = "";
+
 	// The size of the output that should be generated.
 	int size[3];
 
@@ -23,6 +65,14 @@ struct InputSettings {
 	// to the output size if we are not modifying in blocks.
 	int blockSize[3];
 
+	// Whether to change the block size as the model is synthesized. A block
+	// that fails every attempt is synthesized again as smaller blocks, and
+	// the blocks grow back toward blockSize once they keep succeeding on
+	// their first attempt. Each model starts at blockSize. The size of a
+	// block depends on the blocks before it, so the blocks are synthesized
+	// one at a time even with more than one thread.
+	bool adaptiveBlocks = false;
+
 	// The weight of each label. Labels with more weight are more
 	// likely to be selected.
 	vector<float> weights;
@@ -34,6 +84,12 @@ struct InputSettings {
 	// only needed if we are modifying in blocks.
 	int* initialLabels;
 
+	// With a ground plane, the labels for the initial model's last rows,
+	// from the top down to the ground. Each tiles along x, and the first
+	// one fits below the initial label. These are only needed if we are
+	// modifying in blocks.
+	vector<int> groundLabels;
+
 	// The transition describes which labels can be next to each other.
 	// When transition[direction][labelA][labelB] is true that means labelA
 	// can be just below labelB in the specified direction where x = 0, y = 1, z = 2.
@@ -45,6 +101,10 @@ struct InputSettings {
 	// The amount that each label is supported in each direction.
 	vector<vector<int>> supportCount;
 
+	// The largest value in supportCount. This decides how many bytes are
+	// needed for each AC-4 support counter.
+	int maxSupportCount = 0;
+
 	// The ending of the file for the tiled model.
 	string tiledModelSuffix = "";
 
@@ -92,6 +152,9 @@ bool parseBool(const XMLNode& node, const char* attribute, const bool defaultVal
 // Find an initial label that can tile the plane.
 void findInitialLabel(InputSettings& settings);
 
+// Find the fewest labels that lead from the initial label down to the ground.
+void findGroundLabels(InputSettings& settings);
+
 // Create a transition matrix.
 bool*** createTransition(int numLabels);
 
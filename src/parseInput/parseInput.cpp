@@ -50,6 +50,7 @@ void computeSupport(InputSettings& settings) {
 			}
 			supportingC[dir] = supportingDir;
 			supportCountC[dir ^ 1] = (int)supportingDir.size();
+			settings.maxSupportCount = max(settings.maxSupportCount, (int)supportingDir.size());
 		}
 		settings.supporting[c] = supportingC;
 		settings.supportCount[c] = supportCountC;
@@ -68,7 +69,28 @@ InputSettings* parseInput(const XMLNode& node, microseconds& inputTime) {
 	settings->blockSize[0] = parseInt(node, "blockWidth", 0);
 	settings->blockSize[1] = parseInt(node, "blockLength", 0);
 	settings->blockSize[2] = parseInt(node, "blockHeight", 0);
+	settings->adaptiveBlocks = parseBool(node, "adaptiveBlocks", false);
 	settings->subset = node.getAttributeStr("subset");
+	settings->backtrackDepth = parseInt(node, "backtrack", 0);
+	settings->seed = (uint64_t)parseInt(node, "seed", 0);
+	settings->numThreads = parseInt(node, "threads", 1);
+	settings->speculativeAttempts = max(parseInt(node, "speculate", 1), 1);
+	settings->batchSize = max(parseInt(node, "batch", 0), 0);
+	settings->modelFile = node.getAttributeStr("modelFile");
+
+	// Choose the propagator. AC-4 is used unless another one is given.
+	string propagator = node.getAttributeStr("propagator");
+	if (propagator == "AC3") {
+		settings->useAc4 = false;
+	} else if (propagator == "AC2001") {
+		settings->useAc4 = false;
+		settings->useAc2001 = true;
+	} else if (propagator == "CT") {
+		settings->useAc4 = false;
+		settings->useCompactTable = true;
+	} else if (propagator != "" && propagator != "AC4") {
+		cout << "ERROR: The propagator must be AC3, AC4, AC2001, or CT." << endl;
+	}
 
 	// Switch length and height if length is 0.
 	if (settings->size[1] == 0) {
@@ -89,9 +111,6 @@ InputSettings* parseInput(const XMLNode& node, microseconds& inputTime) {
 		}
 	}
 	settings->periodic = parseBool(node, "periodic", false);
-	if (settings->periodic && (settings->blockSize[0] < settings->size[0] || settings->blockSize[1] < settings->size[1])) {
-		cout << "Periodic not implemented when modifying in blocks." << endl;
-	}
 
 	settings->type = node.getNameStr();
 	if (settings->type == "simpletiled") {
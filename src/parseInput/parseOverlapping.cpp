@@ -198,4 +198,7 @@ void parseOverlapping(InputSettings& settings) {
 		}
 	}
 	findInitialLabel(settings);
+	if (hasGround) {
+		findGroundLabels(settings);
+	}
 }
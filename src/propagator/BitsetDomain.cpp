@@ -0,0 +1,147 @@
+// Copyright (c) 2021 Paul Merrell
+#include "BitsetDomain.h"
+#include <cstring>
+
+// Rows are aligned to the start of a cache line.
+const int cacheLineWords = 8;
+
+BitsetDomain::BitsetDomain(const int* newSize, int newNumLabels, const float* newWeights) {
+	for (int dim = 0; dim < 3; dim++) {
+		size[dim] = newSize[dim];
+	}
+	numLabels = newNumLabels;
+	numCells = size[0] * size[1] * size[2];
+	wordsPerCell = (numLabels + 63) / 64;
+	kernels = &domainKernels();
+	trailing = false;
+
+	size_t numWords = (size_t)numCells * wordsPerCell;
+	allocation = new uint64_t[numWords + cacheLineWords];
+	uintptr_t address = reinterpret_cast<uintptr_t>(allocation);
+	uintptr_t misalignment = address % (cacheLineWords * sizeof(uint64_t));
+	words = allocation;
+	if (misalignment != 0) {
+		words += (cacheLineWords * sizeof(uint64_t) - misalignment) / sizeof(uint64_t);
+	}
+
+	fullRow = new uint64_t[wordsPerCell];
+	for (int i = 0; i < wordsPerCell; i++) {
+		fullRow[i] = ~uint64_t(0);
+	}
+	// Clear the padding bits past the last label.
+	if (numLabels % 64 != 0) {
+		fullRow[wordsPerCell - 1] = (uint64_t(1) << (numLabels % 64)) - 1;
+	}
+
+	weights = newWeights;
+	fullWeightSum = 0;
+	for (int label = 0; label < numLabels; label++) {
+		fullWeightSum += weights[label];
+	}
+	weightSums = new double[numCells];
+	labelCounts = new int[numCells];
+
+	// Every cell starts out stale, so it reads as the full row.
+	stamps = new uint32_t[numCells]();
+	epoch = 1;
+	snapshotWords = nullptr;
+	snapshotStamps = nullptr;
+	snapshotWeightSums = nullptr;
+	snapshotLabelCounts = nullptr;
+	snapshotEpoch = 0;
+}
+
+BitsetDomain::~BitsetDomain() {
+	delete[] allocation;
+	delete[] fullRow;
+	delete[] stamps;
+	delete[] weightSums;
+	delete[] labelCounts;
+	delete[] snapshotWords;
+	delete[] snapshotStamps;
+	delete[] snapshotWeightSums;
+	delete[] snapshotLabelCounts;
+}
+
+// Remove every label from the cell except the given one.
+void BitsetDomain::setOnly(int cell, int label) {
+	uint64_t* bits = writableRow(cell);
+	if (trailing) {
+		for (int i = 0; i < wordsPerCell; i++) {
+			uint64_t word = bits[i];
+			while (word) {
+				int removed = 64 * i + countTrailingZeros(word);
+				if (removed != label) {
+					trail.push_back({ cell, removed });
+				}
+				word &= word - 1;
+			}
+		}
+		if (!isPossible(cell, label)) {
+			trail.push_back({ cell, -(label + 1) });
+		}
+	}
+	memset(bits, 0, wordsPerCell * sizeof(uint64_t));
+	bits[label >> 6] = uint64_t(1) << (label & 63);
+	weightSums[cell] = weights[label];
+	labelCounts[cell] = 1;
+}
+
+// Make every label possible in every cell. This starts a new epoch so the
+// rows are reinitialized as they are written.
+void BitsetDomain::reset() {
+	epoch++;
+	if (epoch == 0) {
+		// The epoch wrapped around. Clear the stamps so no cell looks current.
+		memset(stamps, 0, numCells * sizeof(uint32_t));
+		epoch = 1;
+	}
+	trail.clear();
+}
+
+// Undo the changes made since the trail had the given size.
+void BitsetDomain::rollback(int checkpoint) {
+	while ((int)trail.size() > checkpoint) {
+		LabelRemoval change = trail.back();
+		trail.pop_back();
+		uint64_t* bits = writableRow(change.cell);
+		if (change.label >= 0) {
+			bits[change.label >> 6] |= uint64_t(1) << (change.label & 63);
+			weightSums[change.cell] += weights[change.label];
+			labelCounts[change.cell]++;
+		} else {
+			int label = -(change.label + 1);
+			bits[label >> 6] &= ~(uint64_t(1) << (label & 63));
+			weightSums[change.cell] -= weights[label];
+			labelCounts[change.cell]--;
+		}
+	}
+}
+
+// Save a copy of every cell's labels. The stamps are saved along with the
+// rows, so cells that are stale now are still stale when restored.
+void BitsetDomain::saveSnapshot() {
+	size_t numWords = (size_t)numCells * wordsPerCell;
+	if (snapshotWords == nullptr) {
+		snapshotWords = new uint64_t[numWords];
+		snapshotStamps = new uint32_t[numCells];
+		snapshotWeightSums = new double[numCells];
+		snapshotLabelCounts = new int[numCells];
+	}
+	memcpy(snapshotWords, words, numWords * sizeof(uint64_t));
+	memcpy(snapshotStamps, stamps, numCells * sizeof(uint32_t));
+	memcpy(snapshotWeightSums, weightSums, numCells * sizeof(double));
+	memcpy(snapshotLabelCounts, labelCounts, numCells * sizeof(int));
+	snapshotEpoch = epoch;
+}
+
+// Restore the labels saved by saveSnapshot. This clears the trail.
+void BitsetDomain::restoreSnapshot() {
+	memcpy(words, snapshotWords, (size_t)numCells * wordsPerCell * sizeof(uint64_t));
+	memcpy(stamps, snapshotStamps, numCells * sizeof(uint32_t));
+	memcpy(weightSums, snapshotWeightSums, numCells * sizeof(double));
+	memcpy(labelCounts, snapshotLabelCounts, numCells * sizeof(int));
+	// Every stamp now comes from the snapshot, so none is newer than its epoch.
+	epoch = snapshotEpoch;
+	trail.clear();
+}
@@ -0,0 +1,220 @@
+// Copyright (c) 2021 Paul Merrell
+#ifndef BITSET_DOMAIN
+#define BITSET_DOMAIN
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "DomainKernels.h"
+
+// A label that has been removed from a cell.
+struct LabelRemoval {
+	int cell;
+	int label;
+};
+
+// Stores the set of possible labels for every cell in the block. Each cell
+// has one row of bits, one bit per label, padded to a whole number of 64-bit
+// words. The rows are stored in one contiguous, cache-line-aligned array
+// indexed by the linearized (x, y, z) position.
+//
+// Resetting is lazy. Each cell is stamped with the epoch it was last written
+// in, and resetting only starts a new epoch. A cell with an old stamp reads
+// as the full row and is reinitialized the first time it is written.
+//
+// The number of possible labels in each cell and the sum of their weights
+// are kept up to date as labels are removed, so neither needs to be counted.
+class BitsetDomain {
+	private:
+		// The raw allocation and the aligned start of the rows.
+		uint64_t* allocation;
+		uint64_t* words;
+		// A row with every label set. Used when resetting the block.
+		uint64_t* fullRow;
+		// The epoch each cell was last written in.
+		uint32_t* stamps;
+		// The weight of each label, the sum of the weights of the possible
+		// labels in each cell, and the sum of every label's weight.
+		const float* weights;
+		double* weightSums;
+		double fullWeightSum;
+		// The number of labels still possible in each cell.
+		int* labelCounts;
+		uint32_t epoch;
+		int size[3];
+		int numCells;
+		int numLabels;
+		int wordsPerCell;
+		// The kernels used when a row is longer than one word.
+		const DomainKernels* kernels;
+		// When trailing, every change is recorded so that it can be undone.
+		// A negative label -(label + 1) means the label was added instead.
+		bool trailing;
+		std::vector<LabelRemoval> trail;
+		// A copy of the rows, stamps, weight sums and counts saved by saveSnapshot.
+		uint64_t* snapshotWords;
+		uint32_t* snapshotStamps;
+		double* snapshotWeightSums;
+		int* snapshotLabelCounts;
+		uint32_t snapshotEpoch;
+
+	public:
+		BitsetDomain(const int* newSize, int newNumLabels, const float* newWeights);
+		~BitsetDomain();
+
+		// The linear index of the cell at (x, y, z).
+		inline int index(int x, int y, int z) const {
+			return (x * size[1] + y) * size[2] + z;
+		}
+
+		// The (x, y, z) position of the cell at the given linear index.
+		inline void position(int cell, int& x, int& y, int& z) const {
+			z = cell % size[2];
+			cell /= size[2];
+			y = cell % size[1];
+			x = cell / size[1];
+		}
+
+		// The bits for the cell at the given linear index, for reading.
+		inline const uint64_t* row(int cell) const {
+			if (stamps[cell] != epoch) {
+				return fullRow;
+			}
+			return words + (size_t)cell * wordsPerCell;
+		}
+
+		// The bits for the cell at the given linear index, for writing. This
+		// reinitializes the cell if it has not been written in this epoch.
+		inline uint64_t* writableRow(int cell) {
+			uint64_t* bits = words + (size_t)cell * wordsPerCell;
+			if (stamps[cell] != epoch) {
+				for (int i = 0; i < wordsPerCell; i++) {
+					bits[i] = fullRow[i];
+				}
+				weightSums[cell] = fullWeightSum;
+				labelCounts[cell] = numLabels;
+				stamps[cell] = epoch;
+			}
+			return bits;
+		}
+
+		inline bool isPossible(int cell, int label) const {
+			return (row(cell)[label >> 6] >> (label & 63)) & 1;
+		}
+
+		// Remove a label that is currently possible.
+		inline void remove(int cell, int label) {
+			writableRow(cell)[label >> 6] &= ~(uint64_t(1) << (label & 63));
+			weightSums[cell] -= weights[label];
+			labelCounts[cell]--;
+			if (trailing) {
+				trail.push_back({ cell, label });
+			}
+		}
+
+		// Remove every label in the bits from word i of the cell. The labels
+		// must currently be possible.
+		inline void removeBits(int cell, int i, uint64_t bits) {
+			writableRow(cell)[i] &= ~bits;
+			labelCounts[cell] -= popcount64(bits);
+			while (bits) {
+				int label = 64 * i + countTrailingZeros(bits);
+				weightSums[cell] -= weights[label];
+				if (trailing) {
+					trail.push_back({ cell, label });
+				}
+				bits &= bits - 1;
+			}
+		}
+
+		// Returns true if any label is still possible in the cell.
+		inline bool any(int cell) const {
+			return count(cell) != 0;
+		}
+
+		// Returns true if any label in the mask is possible in the cell.
+		inline bool intersects(int cell, const uint64_t* mask) const {
+			if (wordsPerCell == 1) {
+				return (row(cell)[0] & mask[0]) != 0;
+			}
+			return kernels->intersects(row(cell), mask, wordsPerCell);
+		}
+
+		// Returns the first label at or after start that is in the mask and
+		// possible in the cell, or -1 if there is none.
+		inline int firstCommon(int cell, const uint64_t* mask, int start) const {
+			if (start >= numLabels) {
+				return -1;
+			}
+			const uint64_t* bits = row(cell);
+			int i = start >> 6;
+			uint64_t word = bits[i] & mask[i] & (~uint64_t(0) << (start & 63));
+			while (true) {
+				if (word) {
+					return 64 * i + countTrailingZeros(word);
+				}
+				i++;
+				if (i == wordsPerCell) {
+					return -1;
+				}
+				word = bits[i] & mask[i];
+			}
+		}
+
+		// The number of labels still possible in the cell.
+		inline int count(int cell) const {
+			return stamps[cell] != epoch ? numLabels : labelCounts[cell];
+		}
+
+		// The lowest label still possible in the cell, or -1 if there is none.
+		inline int firstLabel(int cell) const {
+			const uint64_t* bits = row(cell);
+			for (int i = 0; i < wordsPerCell; i++) {
+				if (bits[i]) {
+					return 64 * i + countTrailingZeros(bits[i]);
+				}
+			}
+			return -1;
+		}
+
+		// The sum of the weights of the labels still possible in the cell.
+		inline double weightSum(int cell) const {
+			return stamps[cell] != epoch ? fullWeightSum : weightSums[cell];
+		}
+
+		// The weight of the label.
+		inline float weight(int label) const {
+			return weights[label];
+		}
+
+		// Remove every label from the cell except the given one.
+		void setOnly(int cell, int label);
+
+		// Make every label possible in every cell. This also clears the trail.
+		void reset();
+
+		// Save a copy of every cell's labels.
+		void saveSnapshot();
+
+		// Restore the labels saved by saveSnapshot. This clears the trail.
+		void restoreSnapshot();
+
+		// The current epoch. This changes every time the domain is reset.
+		uint32_t getEpoch() const { return epoch; }
+
+		// Start or stop recording changes on the trail.
+		void setTrailing(bool newTrailing) { trailing = newTrailing; }
+		bool isTrailing() const { return trailing; }
+
+		// The number of changes on the trail. This is used as a checkpoint.
+		int trailSize() const { return (int)trail.size(); }
+		const LabelRemoval& trailEntry(int i) const { return trail[i]; }
+
+		// Undo the changes made since the trail had the given size.
+		void rollback(int checkpoint);
+
+		int getNumCells() const { return numCells; }
+		int getWordsPerCell() const { return wordsPerCell; }
+};
+
+#endif // BITSET_DOMAIN
@@ -0,0 +1,75 @@
+// Copyright (c) 2021 Paul Merrell
+#ifndef BLOCK_BOUNDS
+#define BLOCK_BOUNDS
+
+// The change in position for each direction in the order -X, +X, -Y, +Y, -Z, +Z.
+constexpr int directionOffsets[6][3] = {
+	{ -1, 0, 0 }, { 1, 0, 0 },
+	{ 0, -1, 0 }, { 0, 1, 0 },
+	{ 0, 0, -1 }, { 0, 0, 1 }
+};
+
+// The bounds of the block that the propagators work on. Labels are only
+// propagated between cells inside these bounds, or across the edge of the
+// model if it is periodic and the block covers the whole model along that
+// dimension. When the model is modified in blocks, the synthesizer wraps the
+// boundaries of the blocks around the model instead.
+struct BlockBounds {
+	// The lowest and highest position along each dimension.
+	int lower[3];
+	int upper[3];
+	// The size of the model, used to wrap around periodic outputs.
+	int size[3];
+	// Whether labels are propagated across the edge along each dimension.
+	bool wraps[3];
+
+	BlockBounds(const int* possibilitySize, const int* offset, const int* modelSize, bool periodic) {
+		for (int dim = 0; dim < 3; dim++) {
+			lower[dim] = offset[dim];
+			upper[dim] = possibilitySize[dim] - offset[dim] - 1;
+			size[dim] = modelSize[dim];
+			wraps[dim] = periodic && dim < 2 && possibilitySize[dim] == modelSize[dim];
+		}
+	}
+
+	// Make the block the given number of cells long along each dimension.
+	// The block must stay the whole model along the dimensions that wrap.
+	void setExtent(const int extent[3]) {
+		for (int dim = 0; dim < 3; dim++) {
+			upper[dim] = lower[dim] + extent[dim] - 1;
+		}
+	}
+
+	// Find the neighbor of (x, y, z) in the direction. Returns false if labels
+	// should not be propagated to it. The number of dimensions and whether the
+	// output is periodic are template parameters so that each propagator can
+	// compile the checks for the other cases out of its inner loop.
+	template <int NumDims, bool Periodic>
+	inline bool neighbor(int x, int y, int z, int dir, int& xB, int& yB, int& zB) const {
+		xB = x + directionOffsets[dir][0];
+		yB = y + directionOffsets[dir][1];
+		zB = z + directionOffsets[dir][2];
+		if (Periodic) {
+			switch (dir) {
+			case 0: if (xB < lower[0]) { if (!wraps[0]) { return false; } xB += size[0]; } break;
+			case 1: if (xB > upper[0]) { if (!wraps[0]) { return false; } xB -= size[0]; } break;
+			case 2: if (yB < lower[1]) { if (!wraps[1]) { return false; } yB += size[1]; } break;
+			case 3: if (yB > upper[1]) { if (!wraps[1]) { return false; } yB -= size[1]; } break;
+			case 4: if (NumDims == 2 || zB <= lower[2]) { return false; } break;
+			case 5: if (NumDims == 2 || zB > upper[2]) { return false; } break;
+			}
+		} else {
+			switch (dir) {
+			case 0: if (xB < lower[0]) { return false; } break;
+			case 1: if (xB > upper[0]) { return false; } break;
+			case 2: if (yB < lower[1]) { return false; } break;
+			case 3: if (yB > upper[1]) { return false; } break;
+			case 4: if (NumDims == 2 || zB < lower[2]) { return false; } break;
+			case 5: if (NumDims == 2 || zB > upper[2]) { return false; } break;
+			}
+		}
+		return true;
+	}
+};
+
+#endif // BLOCK_BOUNDS
@@ -0,0 +1,233 @@
+// Copyright (c) 2021 Paul Merrell
+#include "DomainKernels.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// GCC and Clang only emit wide instructions in functions that ask for them.
+// MSVC allows the intrinsics anywhere.
+#if defined(KERNELS_X86) && defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+/** Scalar kernels. These also handle the words left over after the vectors. **/
+
+bool intersectsScalar(const uint64_t* a, const uint64_t* b, int n) {
+	for (int i = 0; i < n; i++) {
+		if (a[i] & b[i]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+const DomainKernels scalarKernels = { "Scalar", intersectsScalar };
+
+#ifdef KERNELS_X86
+
+/** SSE2 kernels. Two words at a time. **/
+
+TARGET_SSE2 bool intersectsSse2(const uint64_t* a, const uint64_t* b, int n) {
+	int i = 0;
+	for (; i + 2 <= n; i += 2) {
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+		__m128i both = _mm_and_si128(va, vb);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(both, _mm_setzero_si128())) != 0xFFFF) {
+			return true;
+		}
+	}
+	return intersectsScalar(a + i, b + i, n - i);
+}
+
+const DomainKernels sse2Kernels = { "SSE2", intersectsSse2 };
+
+/** AVX2 kernels. Four words at a time. **/
+
+TARGET_AVX2 bool intersectsAvx2(const uint64_t* a, const uint64_t* b, int n) {
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+		if (!_mm256_testz_si256(va, vb)) {
+			return true;
+		}
+	}
+	return intersectsScalar(a + i, b + i, n - i);
+}
+
+const DomainKernels avx2Kernels = { "AVX2", intersectsAvx2 };
+
+/** AVX-512 kernels. Eight words at a time. **/
+
+TARGET_AVX512 bool intersectsAvx512(const uint64_t* a, const uint64_t* b, int n) {
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m512i va = _mm512_loadu_si512((const void*)(a + i));
+		__m512i vb = _mm512_loadu_si512((const void*)(b + i));
+		if (_mm512_test_epi64_mask(va, vb)) {
+			return true;
+		}
+	}
+	return intersectsScalar(a + i, b + i, n - i);
+}
+
+const DomainKernels avx512Kernels = { "AVX-512", intersectsAvx512 };
+
+void cpuid(int leaf, int subleaf, unsigned int registers[4]) {
+#ifdef _MSC_VER
+	int values[4];
+	__cpuidex(values, leaf, subleaf);
+	for (int i = 0; i < 4; i++) {
+		registers[i] = (unsigned int)values[i];
+	}
+#else
+	__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// Returns the register state the operating system saves on a context switch.
+uint64_t enabledRegisterState() {
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int low, high;
+	__asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+	return ((uint64_t)high << 32) | low;
+#endif
+}
+
+// Find the widest instruction set supported by both the CPU and the OS.
+KernelLevel detectKernelLevel() {
+	unsigned int registers[4];
+	cpuid(0, 0, registers);
+	unsigned int maxLeaf = registers[0];
+	cpuid(1, 0, registers);
+	bool sse2 = (registers[3] >> 26) & 1;
+	bool osxsave = (registers[2] >> 27) & 1;
+	bool avx = (registers[2] >> 28) & 1;
+	if (!sse2) {
+		return KERNEL_SCALAR;
+	}
+	if (!osxsave || !avx || maxLeaf < 7) {
+		return KERNEL_SSE2;
+	}
+	uint64_t state = enabledRegisterState();
+	// The XMM and YMM registers must be saved for AVX2. AVX-512 also needs the
+	// opmask and ZMM registers.
+	bool ymmEnabled = (state & 0x6) == 0x6;
+	bool zmmEnabled = (state & 0xE6) == 0xE6;
+	cpuid(7, 0, registers);
+	bool avx2 = (registers[1] >> 5) & 1;
+	bool avx512f = (registers[1] >> 16) & 1;
+	if (avx512f && zmmEnabled) {
+		return KERNEL_AVX512;
+	}
+	if (avx2 && ymmEnabled) {
+		return KERNEL_AVX2;
+	}
+	return KERNEL_SSE2;
+}
+
+#else
+
+KernelLevel detectKernelLevel() {
+	return KERNEL_SCALAR;
+}
+
+#endif // KERNELS_X86
+
+const DomainKernels* domainKernelsForLevel(KernelLevel level) {
+	static const KernelLevel supported = detectKernelLevel();
+	if (level > supported) {
+		return nullptr;
+	}
+	switch (level) {
+		case KERNEL_SCALAR: return &scalarKernels;
+#ifdef KERNELS_X86
+		case KERNEL_SSE2: return &sse2Kernels;
+		case KERNEL_AVX2: return &avx2Kernels;
+		case KERNEL_AVX512: return &avx512Kernels;
+#endif
+		default: return nullptr;
+	}
+}
+
+const DomainKernels* widestKernels() {
+	for (int level = NUM_KERNEL_LEVELS - 1; level > KERNEL_SCALAR; level--) {
+		const DomainKernels* kernels = domainKernelsForLevel((KernelLevel)level);
+		if (kernels != nullptr) {
+			return kernels;
+		}
+	}
+	return &scalarKernels;
+}
+
+const DomainKernels& domainKernels() {
+	static const DomainKernels* kernels = widestKernels();
+	return *kernels;
+}
+
+// Time one kernel over many rows. Returns nanoseconds per row.
+template <typename Operation>
+double timeKernel(int numRows, int repetitions, Operation operation) {
+	auto startTime = high_resolution_clock::now();
+	for (int r = 0; r < repetitions; r++) {
+		for (int i = 0; i < numRows; i++) {
+			operation(i);
+		}
+	}
+	auto endTime = high_resolution_clock::now();
+	return duration_cast<nanoseconds>(endTime - startTime).count() / (double)(numRows * repetitions);
+}
+
+void benchmarkDomainKernels() {
+	const int numRows = 1024;
+	mt19937_64 generator(1);
+	cout << "Domain kernel benchmark (ns per row, speedup over scalar)" << endl;
+	for (int numLabels = 16; numLabels <= 4096; numLabels *= 2) {
+		int n = (numLabels + 63) / 64;
+		// Sparse rows so that intersects scans most of the row before finding
+		// a common bit.
+		vector<uint64_t> a(numRows * n, 0), b(numRows * n, 0);
+		for (int i = 0; i < numRows; i++) {
+			a[i * n + generator() % n] = generator() & ((numLabels < 64) ? (1ULL << numLabels) - 1 : ~0ULL);
+			b[i * n + n - 1] = generator() & a[i * n + n - 1];
+		}
+		int repetitions = max(1, 4096 / n);
+		cout << "Labels: " << numLabels << endl;
+		double scalarTime = 0;
+		volatile int sink = 0;
+		for (int level = 0; level < NUM_KERNEL_LEVELS; level++) {
+			const DomainKernels* kernels = domainKernelsForLevel((KernelLevel)level);
+			if (kernels == nullptr) {
+				continue;
+			}
+			double time = timeKernel(numRows, repetitions, [&](int i) { sink += kernels->intersects(&a[i * n], &b[i * n], n); });
+			if (level == KERNEL_SCALAR) {
+				scalarTime = time;
+			}
+			cout << "   " << kernels->name << ": intersects " << time << " (" << scalarTime / time << "x)" << endl;
+		}
+	}
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2021 Paul Merrell
+#ifndef DOMAIN_KERNELS
+#define DOMAIN_KERNELS
+
+#include <cstdint>
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// The instruction sets the domain kernels are implemented with, from the
+// narrowest to the widest.
+enum KernelLevel { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2, KERNEL_AVX512, NUM_KERNEL_LEVELS };
+
+// Operations on rows of label bits. Each row is n 64-bit words. The domain
+// keeps the number of labels in each cell up to date, so rows never need to
+// be counted or scanned for a set bit.
+struct DomainKernels {
+	const char* name;
+
+	// Returns true if a and b have any bit set in common.
+	bool (*intersects)(const uint64_t* a, const uint64_t* b, int n);
+};
+
+// The widest kernels this CPU supports. These are chosen once, the first
+// time this is called.
+const DomainKernels& domainKernels();
+
+// The kernels for a particular instruction set. Returns nullptr if the CPU
+// or the compiler does not support it.
+const DomainKernels* domainKernelsForLevel(KernelLevel level);
+
+// Count the bits set in a single word.
+inline int popcount64(uint64_t word) {
+#if defined(__GNUC__)
+	return __builtin_popcountll(word);
+#else
+	// The POPCNT instruction is not available on every CPU, so count the
+	// bits in parallel within the word.
+	word = word - ((word >> 1) & 0x5555555555555555ULL);
+	word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+	word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// The index of the lowest set bit in a non-zero word.
+inline int countTrailingZeros(uint64_t word) {
+#if defined(__GNUC__)
+	return __builtin_ctzll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, word);
+	return (int)index;
+#else
+	int count = 0;
+	while (!(word & 1)) {
+		word >>= 1;
+		count++;
+	}
+	return count;
+#endif
+}
+
+// Time each of the supported kernels on label counts from 16 to 4096 and
+// report the speedup over the scalar kernels.
+void benchmarkDomainKernels();
+
+#endif // DOMAIN_KERNELS
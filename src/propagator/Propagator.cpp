@@ -1,40 +1,49 @@
 // Copyright (c) 2021 Paul Merrell
 #include "Propagator.h"
-#include <vector>
+#include "PropagatorAc3.h"
+#include "PropagatorAc4.h"
+#include "PropagatorAc2001.h"
+#include "PropagatorCompactTable.h"
 #include <iostream>
 
 using namespace std;
 
-// Pick a random value given the weights. Higher weight means higher probability.
-int pickFromWeights(float* weights, int n) {
-	float sum = 0;
-	vector<float> cumulativeSums;
-	for (int i = 0; i < n; i++) {
-		sum += weights[i];
-		cumulativeSums.push_back(sum);
-	}
-	if (sum == 0) {
+// Pick a random label from the labels possible in the cell. Higher weight
+// means higher probability. Returns -1 if there are none left to choose.
+int pickFromWeights(const BitsetDomain& domain, int cell, Random& random) {
+	double sum = domain.weightSum(cell);
+	if (sum <= 0) {
 		return -1;
 	}
-	float randomValue = sum * static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-	for (int i = 0; i < n; i++) {
-		if (randomValue < cumulativeSums[i]) {
-			return i;
+	double randomValue = sum * random.nextDouble();
+
+	// Only the possible labels have any weight, so walk the set bits.
+	const uint64_t* bits = domain.row(cell);
+	int wordsPerCell = domain.getWordsPerCell();
+	double cumulativeSum = 0;
+	int label = -1;
+	for (int i = 0; i < wordsPerCell; i++) {
+		uint64_t word = bits[i];
+		while (word) {
+			label = 64 * i + countTrailingZeros(word);
+			word &= word - 1;
+			cumulativeSum += domain.weight(label);
+			if (randomValue < cumulativeSum) {
+				return label;
+			}
 		}
 	}
-	return -1;
+	// The running sum may be slightly larger than the sum of the labels
+	// after many removals, so fall back to the last possible label.
+	return label;
 }
 
-int Propagator::pickLabel(int x, int y, int z) {
-	float* weights = new float[numLabels];
-	for (int i = 0; i < numLabels; i++) {
-		if (isPossible(x, y, z, i)) {
-			weights[i] = settings->weights[i];
-		} else {
-			weights[i] = 0.0;
-		}
-	}
-	int label = pickFromWeights(weights, numLabels);
+int Propagator::chooseLabel(int x, int y, int z, Random& random) {
+	return pickFromWeights(*domain, domain->index(x, y, z), random);
+}
+
+int Propagator::pickLabel(int x, int y, int z, Random& random) {
+	int label = chooseLabel(x, y, z, random);
 	if (label == -1) {
 		return -1;
 	}
@@ -57,4 +66,37 @@ void Propagator::printPossible(int x, int y, int z) {
 		}
 	}
 	cout << endl;
-}
\ No newline at end of file
+}
+
+// Create the rows of bits marking which labels support each label in each
+// direction.
+uint64_t* createCompatibleMasks(const InputSettings& settings, int wordsPerCell) {
+	int numLabels = settings.numLabels;
+	bool*** transition = settings.transition;
+	uint64_t* compatible = new uint64_t[6 * numLabels * wordsPerCell]();
+	for (int dir = 0; dir < 6; dir++) {
+		int dim = dir / 2;
+		bool positive = (dir % 2 == 1);
+		for (int a = 0; a < numLabels; a++) {
+			uint64_t* mask = compatible + ((size_t)dir * numLabels + a) * wordsPerCell;
+			for (int b = 0; b < numLabels; b++) {
+				bool validTransition = positive ? transition[dim][b][a] : transition[dim][a][b];
+				if (validTransition) {
+					mask[b >> 6] |= uint64_t(1) << (b & 63);
+				}
+			}
+		}
+	}
+	return compatible;
+}
+
+Propagator* createPropagator(InputSettings* settings, int* possibilitySize, int* offset) {
+	if (settings->useAc4) {
+		return new PropagatorAc4(settings, possibilitySize, offset);
+	} else if (settings->useAc2001) {
+		return new PropagatorAc2001(settings, possibilitySize, offset);
+	} else if (settings->useCompactTable) {
+		return new PropagatorCompactTable(settings, possibilitySize, offset);
+	}
+	return new PropagatorAc3(settings, possibilitySize, offset);
+}
@@ -2,21 +2,49 @@
 #ifndef PROPAGATOR
 #define PROPAGATOR
 #include "../parseInput/InputSettings.h"
+#include "BitsetDomain.h"
+#include "BlockBounds.h"
+#include "../Random.h"
+#include <cstdint>
 
 class Propagator {
 	int numLabels;
 	InputSettings* settings;
 
+	protected:
+		// The possible labels in each cell of the block. This is created and
+		// deleted by the propagator that extends this.
+		BitsetDomain* domain;
+
+		// The cells that labels are propagated between. This is also created
+		// and deleted by the propagator that extends this.
+		BlockBounds* bounds;
+
 	public:
 		Propagator(InputSettings* newSettings) {
 			settings = newSettings;
 			numLabels = newSettings->numLabels;
+			domain = nullptr;
+			bounds = nullptr;
+		}
+		virtual ~Propagator() {}
+
+		// Only propagate within the first extent cells of the block along
+		// each dimension, starting at the offset, and from the cells just
+		// past them. This lets a smaller block be synthesized with the same
+		// propagator. The block must be reset before it is used again.
+		void setBlockExtent(const int extent[3]) {
+			bounds->setExtent(extent);
 		}
 
-		// Set a label in the block at the given position.
+		// Set a label in the block at the given position. Returns false if a
+		// cell has no possible labels left. Propagation may stop early when
+		// this happens, so the block must then be rolled back, reset or
+		// restored from the snapshot before it is used again.
 		virtual bool setBlockLabel(int label, int position[3]) = 0;
 
-		// Remove a label from the given position.
+		// Remove a label from the given position. Returns false in the same
+		// cases as setBlockLabel.
 		virtual bool removeLabel(int label, int position[3]) = 0;
 
 		// Reset the block to include all possible labels.
@@ -25,12 +53,51 @@ class Propagator {
 		// Returns true if the label at this location is possible.
 		virtual bool isPossible(int x, int y, int z, int label) = 0;
 
-		// Pick from one of the possible labels at the (x, y, z). Return -1 if there
-		// are none left to choose.
-		int pickLabel(int x, int y, int z);
+		// Returns a checkpoint of the current state. This is only valid while
+		// trailing is on and until the next call to resetBlock.
+		virtual int checkpoint() = 0;
+
+		// Undo every change made since the checkpoint.
+		virtual void rollback(int checkpoint) = 0;
+
+		// Save the current state so it can be restored without recomputing it.
+		virtual void saveSnapshot() = 0;
+
+		// Restore the state saved by saveSnapshot.
+		virtual void restoreSnapshot() = 0;
+
+		// The number of labels still possible at the (x, y, z).
+		int domainSize(int x, int y, int z) const {
+			return domain->count(domain->index(x, y, z));
+		}
+
+		// The only label still possible at the (x, y, z), or -1 if there is
+		// more than one or none.
+		int singleLabel(int x, int y, int z) const {
+			int cell = domain->index(x, y, z);
+			return domain->count(cell) == 1 ? domain->firstLabel(cell) : -1;
+		}
+
+		// Choose one of the possible labels at the (x, y, z) using the random
+		// number generator without setting it. Return -1 if there are none
+		// left to choose.
+		int chooseLabel(int x, int y, int z, Random& random);
+
+		// Pick from one of the possible labels at the (x, y, z) using the
+		// random number generator. Return -1 if there are none left to choose
+		// or if setting the label leaves a cell with no labels.
+		int pickLabel(int x, int y, int z, Random& random);
 
 		// Just for debugging.
 		void printPossible(int x, int y, int z);
 };
 
+// Create the rows of bits marking which labels b support label a when b is
+// in the neighboring cell in direction dir. Row (dir, a) starts at word
+// (dir * numLabels + a) * wordsPerCell.
+uint64_t* createCompatibleMasks(const InputSettings& settings, int wordsPerCell);
+
+// Create the propagator the settings ask for, for a block of the given size.
+Propagator* createPropagator(InputSettings* settings, int* possibilitySize, int* offset);
+
 #endif // PROPAGATOR
@@ -0,0 +1,194 @@
+// Copyright (c) 2021 Paul Merrell
+#include "PropagatorAc2001.h"
+#include <cstdint>
+
+PropagatorAc2001::PropagatorAc2001(
+	InputSettings* newSettings,
+	int* newPossibilitySize,
+	int* newOffset
+) : Propagator(newSettings) {
+	settings = newSettings;
+	possibilitySize = newPossibilitySize;
+	offset = newOffset;
+	numLabels = settings->numLabels;
+	size = settings->size;
+	numDirections = 2 * settings->numDims;
+
+	domain = new BitsetDomain(possibilitySize, numLabels, settings->weights.data());
+	compatible = createCompatibleMasks(*settings, domain->getWordsPerCell());
+
+	// Each cell is in the queue at most once, so the queue never needs to grow.
+	inQueue = new bool[domain->getNumCells()]();
+	updateQueue = new RingBuffer<int>(domain->getNumCells());
+	domain->setTrailing(settings->backtrackDepth > 0);
+	bounds = new BlockBounds(possibilitySize, offset, size, settings->periodic);
+
+	// Use the narrowest residues that can index every word of a row.
+	size_t numResidues = (size_t)domain->getNumCells() * numDirections * numLabels;
+	int wordsPerCell = domain->getWordsPerCell();
+	if (wordsPerCell <= UINT8_MAX + 1) {
+		residueWidth = sizeof(uint8_t);
+		residues = new uint8_t[numResidues]();
+		chooseFunctions<uint8_t>();
+	} else if (wordsPerCell <= UINT16_MAX + 1) {
+		residueWidth = sizeof(uint16_t);
+		residues = new uint16_t[numResidues]();
+		chooseFunctions<uint16_t>();
+	} else {
+		residueWidth = sizeof(uint32_t);
+		residues = new uint32_t[numResidues]();
+		chooseFunctions<uint32_t>();
+	}
+}
+
+PropagatorAc2001::~PropagatorAc2001() {
+	if (residueWidth == sizeof(uint8_t)) {
+		delete[] (uint8_t*)residues;
+	} else if (residueWidth == sizeof(uint16_t)) {
+		delete[] (uint16_t*)residues;
+	} else {
+		delete[] (uint32_t*)residues;
+	}
+	delete[] inQueue;
+	delete updateQueue;
+	delete bounds;
+	delete[] compatible;
+	delete domain;
+}
+
+// Choose the propagation loop for the number of dimensions and periodicity.
+template <typename Residue>
+void PropagatorAc2001::chooseFunctions() {
+	if (settings->numDims == 2) {
+		propagateFunction = settings->periodic ?
+			&PropagatorAc2001::propagateQueueIn<Residue, 2, true> :
+			&PropagatorAc2001::propagateQueueIn<Residue, 2, false>;
+	} else {
+		propagateFunction = settings->periodic ?
+			&PropagatorAc2001::propagateQueueIn<Residue, 3, true> :
+			&PropagatorAc2001::propagateQueueIn<Residue, 3, false>;
+	}
+}
+
+// Propagate the changes from every cell in the update queue. Returns false
+// if a cell has no possible labels left.
+bool PropagatorAc2001::propagateQueue() {
+	return (this->*propagateFunction)();
+}
+
+template <typename Residue, int NumDims, bool Periodic>
+bool PropagatorAc2001::propagateQueueIn() {
+	while (!updateQueue->empty()) {
+		int cell = updateQueue->pop();
+		inQueue[cell] = false;
+
+		// Check if any possible labels are still left.
+		// If not we have failed.
+		if (!domain->any(cell)) {
+			while (!updateQueue->empty()) {
+				inQueue[updateQueue->pop()] = false;
+			}
+			return false;
+		}
+		int x, y, z;
+		domain->position(cell, x, y, z);
+		for (int dir = 0; dir < 2 * NumDims; dir++) {
+			int xA, yA, zA;
+			if (bounds->neighbor<NumDims, Periodic>(x, y, z, dir, xA, yA, zA)) {
+				revise<Residue>(domain->index(xA, yA, zA), cell, dir);
+			}
+		}
+	}
+	return true;
+}
+
+// Remove the labels in cell A that have no support in cell B, where A is the
+// neighbor of B in the direction.
+template <typename Residue>
+void PropagatorAc2001::revise(int cellA, int cellB, int dir) {
+	Residue* cellResidues = (Residue*)residues + ((size_t)cellA * numDirections + dir) * numLabels;
+	int wordsPerCell = domain->getWordsPerCell();
+	for (int i = 0; i < wordsPerCell; i++) {
+		uint64_t word = domain->row(cellA)[i];
+		while (word) {
+			int a = 64 * i + countTrailingZeros(word);
+			word &= word - 1;
+
+			// The label is still supported if the word its last support was
+			// found in still has a support.
+			const uint64_t* mask = compatibleMask(dir, a);
+			int last = cellResidues[a];
+			if (domain->row(cellB)[last] & mask[last]) {
+				continue;
+			}
+
+			// Search for a new support after that word. Labels before it can
+			// only be possible again after a rollback, so wrap around to check.
+			int support = domain->firstCommon(cellB, mask, 64 * (last + 1));
+			if (support == -1) {
+				support = domain->firstCommon(cellB, mask, 0);
+			}
+			if (support == -1) {
+				domain->remove(cellA, a);
+				if (!inQueue[cellA]) {
+					updateQueue->push(cellA);
+					inQueue[cellA] = true;
+				}
+			} else {
+				cellResidues[a] = (Residue)(support >> 6);
+			}
+		}
+	}
+}
+
+// Remove a label in the block at the given position.
+bool PropagatorAc2001::removeLabel(int label, int position[3]) {
+	int cell = domain->index(position[0], position[1], position[2]);
+	if (!domain->isPossible(cell, label)) {
+		return true;
+	}
+	domain->remove(cell, label);
+	updateQueue->push(cell);
+	inQueue[cell] = true;
+	return propagateQueue();
+}
+
+// Set a label in the block at the given position.
+bool PropagatorAc2001::setBlockLabel(int label, int position[3]) {
+	int cell = domain->index(position[0], position[1], position[2]);
+	domain->setOnly(cell, label);
+	updateQueue->push(cell);
+	inQueue[cell] = true;
+	return propagateQueue();
+}
+
+// Reset the block to include all possible labels. The residues are kept.
+void PropagatorAc2001::resetBlock() {
+	domain->reset();
+}
+
+// Returns true if the label at this location is possible.
+bool PropagatorAc2001::isPossible(int x, int y, int z, int label) {
+	return domain->isPossible(domain->index(x, y, z), label);
+}
+
+// Returns a checkpoint of the current state.
+int PropagatorAc2001::checkpoint() {
+	return domain->trailSize();
+}
+
+// Undo every change made since the checkpoint. The residues are still valid
+// hints afterwards, so they are not restored.
+void PropagatorAc2001::rollback(int checkpoint) {
+	domain->rollback(checkpoint);
+}
+
+// Save the current state so it can be restored without recomputing it.
+void PropagatorAc2001::saveSnapshot() {
+	domain->saveSnapshot();
+}
+
+// Restore the state saved by saveSnapshot.
+void PropagatorAc2001::restoreSnapshot() {
+	domain->restoreSnapshot();
+}
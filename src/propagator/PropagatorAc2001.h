@@ -0,0 +1,94 @@
+// Copyright (c) 2021 Paul Merrell
+#ifndef PROPAGATOR_AC_2001
+#define PROPAGATOR_AC_2001
+
+#include "Propagator.h"
+#include "BitsetDomain.h"
+#include "RingBuffer.h"
+#include "BlockBounds.h"
+
+// Propagates labels with AC-2001 (Bessiere and Regin, 2001). Like AC-3 it
+// revises the neighbors of every changed cell, but it remembers for each
+// cell, label and direction the last neighboring label found to support it.
+// The support is only searched for again once that label is removed.
+class PropagatorAc2001 : public Propagator {
+	private:
+		InputSettings* settings;
+		// The cells whose neighbors need to be revised, and whether each cell
+		// is already waiting in the queue.
+		RingBuffer<int>* updateQueue;
+		bool* inQueue;
+		int* possibilitySize;
+		int* size;
+		int* offset;
+		int numLabels;
+		int numDirections;
+
+		// compatible[dir][a] is a row of bits with the labels b that support
+		// label a when b is in the neighboring cell in direction dir.
+		uint64_t* compatible;
+
+		// Where the last support for each label was found, stored as
+		// [cell][dir][label]. Each residue is the index of the 64-bit word of
+		// the row the support is in, so it takes residueWidth = 1 byte for up
+		// to 16384 labels. This is still one entry per cell, label and
+		// direction like AC-4's counters, but the counters need 2 or 4 bytes
+		// once a label has more than 255 supports, and AC-4 keeps a second
+		// copy of them for snapshots. Residues are only hints, so they are
+		// never reset, saved or rolled back.
+		void* residues;
+		int residueWidth;
+
+		// Returns the mask of labels that support the label in the direction.
+		inline const uint64_t* compatibleMask(int dir, int label) const {
+			return compatible + ((size_t)dir * numLabels + label) * domain->getWordsPerCell();
+		}
+
+		// Remove the labels in cell A with no support in its neighbor B.
+		template <typename Residue>
+		void revise(int cellA, int cellB, int dir);
+
+		// Propagate until the update queue is empty.
+		bool propagateQueue();
+
+		// The version of propagateQueueIn for this residue width, number of
+		// dimensions and periodicity. This is chosen once when the propagator
+		// is created.
+		bool (PropagatorAc2001::*propagateFunction)();
+
+		template <typename Residue>
+		void chooseFunctions();
+
+		template <typename Residue, int NumDims, bool Periodic>
+		bool propagateQueueIn();
+
+	public:
+		PropagatorAc2001(InputSettings* newSettings, int* newPossibilitySize, int* newOffset);
+		~PropagatorAc2001();
+
+		// Set a label in the block at the given position.
+		bool setBlockLabel(int label, int position[3]);
+
+		// Remove a label from the given position.
+		bool removeLabel(int label, int position[3]);
+
+		// Reset the block to include all possible labels.
+		void resetBlock();
+
+		// Returns true if the label at this location is possible.
+		bool isPossible(int x, int y, int z, int label);
+
+		// Returns a checkpoint of the current state.
+		int checkpoint();
+
+		// Undo every change made since the checkpoint.
+		void rollback(int checkpoint);
+
+		// Save the current state so it can be restored without recomputing it.
+		void saveSnapshot();
+
+		// Restore the state saved by saveSnapshot.
+		void restoreSnapshot();
+};
+
+#endif // PROPAGATOR_AC_2001
@@ -12,184 +12,130 @@ PropagatorAc3::PropagatorAc3(
 	numLabels = settings->numLabels;
 	size = settings->size;
 
-	possibleLabels = new bool*** [possibilitySize[0]];
-	inQueue = new bool** [possibilitySize[0]];
-	for (int x = 0; x < possibilitySize[0]; x++) {
-		possibleLabels[x] = new bool** [possibilitySize[1]];
-		inQueue[x] = new bool* [possibilitySize[1]];
-		for (int y = 0; y < possibilitySize[1]; y++) {
-			possibleLabels[x][y] = new bool* [possibilitySize[2]];
-			inQueue[x][y] = new bool[possibilitySize[2]];
-			for (int z = 0; z < possibilitySize[2]; z++) {
-				possibleLabels[x][y][z] = new bool[numLabels];
-			}
-		}
+	domain = new BitsetDomain(possibilitySize, numLabels, settings->weights.data());
+
+	// Precompute the compatible labels for each label and direction.
+	compatible = createCompatibleMasks(*settings, domain->getWordsPerCell());
+
+	// Each cell is in the queue at most once, so the queue never needs to grow.
+	inQueue = new bool[domain->getNumCells()]();
+	updateQueue = new RingBuffer<int>(domain->getNumCells());
+	domain->setTrailing(settings->backtrackDepth > 0);
+
+	// Choose the propagation loop for the number of dimensions and periodicity.
+	bounds = new BlockBounds(possibilitySize, offset, size, settings->periodic);
+	if (settings->numDims == 2) {
+		propagateFunction = settings->periodic ? &PropagatorAc3::propagateQueueIn<2, true> : &PropagatorAc3::propagateQueueIn<2, false>;
+	} else {
+		propagateFunction = settings->periodic ? &PropagatorAc3::propagateQueueIn<3, true> : &PropagatorAc3::propagateQueueIn<3, false>;
 	}
 }
 
-// Remove a label in the block at the given position.
-bool PropagatorAc3::removeLabel(int label, int position[3]) {
-	int x = position[0];
-	int y = position[1];
-	int z = position[2];
-	if (!possibleLabels[x][y][z][label]) {
-		return true;
-	}
+PropagatorAc3::~PropagatorAc3() {
+	delete[] inQueue;
+	delete updateQueue;
+	delete bounds;
+	delete[] compatible;
+	delete domain;
+}
+
+// Propagate the changes from every cell in the update queue. Returns false
+// if a cell has no possible labels left.
+bool PropagatorAc3::propagateQueue() {
+	return (this->*propagateFunction)();
+}
+
+template <int NumDims, bool Periodic>
+bool PropagatorAc3::propagateQueueIn() {
+	while (!updateQueue->empty()) {
+		int cell = updateQueue->pop();
+		inQueue[cell] = false;
 
-	possibleLabels[x][y][z][label] = false;
-	inQueue[x][y][z] = true;
-
-	// ***************************
-	// TODO: Combine this with setBlockLabel.
-	// ***************************
-	std::deque<int*> updateQueue;
-	updateQueue.push_back(position);
-	inQueue[x][y][z] = true;
-	while (updateQueue.size() > 0) {
-		int* update = updateQueue.front();
-		int x = update[0];
-		int y = update[1];
-		int z = update[2];
-
-		// TODO: Check if this makes things faster or not.
 		// Check if any possible labels are still left.
 		// If not we have failed.
-		bool isPossible = false;
-		for (int i = 0; i < numLabels; i++) {
-			if (possibleLabels[x][y][z][i]) {
-				isPossible = true;
-				break;
+		if (!domain->any(cell)) {
+			while (!updateQueue->empty()) {
+				inQueue[updateQueue->pop()] = false;
 			}
-		}
-		if (!isPossible) {
 			return false;
 		}
-		for (int dir = 0; dir < 6; dir++) {
-			propagate(x, y, z, dir, updateQueue);
+		int x, y, z;
+		domain->position(cell, x, y, z);
+		for (int dir = 0; dir < 2 * NumDims; dir++) {
+			int xA, yA, zA;
+			if (bounds->neighbor<NumDims, Periodic>(x, y, z, dir, xA, yA, zA)) {
+				revise(domain->index(xA, yA, zA), cell, dir);
+			}
 		}
-		inQueue[x][y][z] = false;
-		updateQueue.pop_front();
 	}
 	return true;
 }
 
-// Set a label in the block at the given position.
-bool PropagatorAc3::setBlockLabel(int label, int position[3]) {
-	int x = position[0];
-	int y = position[1];
-	int z = position[2];
-	for (int i = 0; i < numLabels; i++) {
-		possibleLabels[x][y][z][i] = (i == label);
+// Remove a label in the block at the given position.
+bool PropagatorAc3::removeLabel(int label, int position[3]) {
+	int cell = domain->index(position[0], position[1], position[2]);
+	if (!domain->isPossible(cell, label)) {
+		return true;
 	}
+	domain->remove(cell, label);
+	updateQueue->push(cell);
+	inQueue[cell] = true;
+	return propagateQueue();
+}
 
-	std::deque<int*> updateQueue;
-	updateQueue.push_back(position);
-	inQueue[x][y][z] = true;
-	while (updateQueue.size() > 0) {
-		int* update = updateQueue.front();
-		int x = update[0];
-		int y = update[1];
-		int z = update[2];
-
-		// TODO: Check if this makes things faster or not.
-		// Check if any possible labels are still left.
-		// If not we have failed.
-		bool isPossible = false;
-		for (int i = 0; i < numLabels; i++) {
-			if (possibleLabels[x][y][z][i]) {
-				isPossible = true;
-				break;
-			}
-		}
-		if (!isPossible) {
-			return false;
-		}
-		for (int dir = 0; dir < 6; dir++) {
-			propagate(x, y, z, dir, updateQueue);
-		}
-		inQueue[x][y][z] = false;
-		updateQueue.pop_front();
-	}
-	return true;
+// Set a label in the block at the given position.
+bool PropagatorAc3::setBlockLabel(int label, int position[3]) {
+	int cell = domain->index(position[0], position[1], position[2]);
+	domain->setOnly(cell, label);
+	updateQueue->push(cell);
+	inQueue[cell] = true;
+	return propagateQueue();
 }
 
 // Set a label in the block at the given position.
 void PropagatorAc3::resetBlock() {
-	for (int x = 0; x < possibilitySize[0]; x++) {
-		for (int y = 0; y < possibilitySize[1]; y++) {
-			for (int z = 0; z < possibilitySize[2]; z++) {
-				inQueue[x][y][z] = false;
-				for (int label = 0; label < numLabels; label++) {
-					possibleLabels[x][y][z][label] = true;
-				}
-			}
-		}
-	}
+	domain->reset();
 }
 
 // Set a label in the block at the given position.
 bool PropagatorAc3::isPossible(int x, int y, int z, int label) {
-	return possibleLabels[x][y][z][label];
+	return domain->isPossible(domain->index(x, y, z), label);
 }
 
-void PropagatorAc3::propagate(int xB, int yB, int zB, int dir, std::deque<int*>& updateQueue) {
-	bool*** transition = settings->transition;
-
-	int xA = xB;
-	int yA = yB;
-	int zA = zB;
-	switch (dir) {
-	case 0: xA--; break;
-	case 1: xA++; break;
-	case 2: yA--; break;
-	case 3: yA++; break;
-	case 4: zA--; break;
-	case 5: zA++; break;
-	}
-	// Do not propagate if this goes outside the bounds of the block.
-	if (settings->periodic) {
-		switch (dir) {
-		case 0: if (xA < offset[0]) { xA += size[0]; } break;
-		case 2: if (yA < offset[1]) { yA += size[1]; } break;
-		case 4: if (zA <= offset[2]) { return; } break;
-		case 1: if (xA > possibilitySize[0] - offset[0] - 1) { xA -= size[0]; } break;
-		case 3: if (yA > possibilitySize[1] - offset[1] - 1) { yA -= size[1]; } break;
-		case 5: if (zA > possibilitySize[2] - offset[2] - 1) { return; } break;
-		}
-	}
-	else {
-		switch (dir) {
-		case 0: if (xB <= offset[0]) { return; } break;
-		case 2: if (yB <= offset[1]) { return; } break;
-		case 4: if (zB <= offset[2]) { return; } break;
-		case 1: if (xB >= possibilitySize[0] - offset[0] - 1) { return; } break;
-		case 3: if (yB >= possibilitySize[1] - offset[1] - 1) { return; } break;
-		case 5: if (zB >= possibilitySize[2] - offset[2] - 1) { return; } break;
-		}
-	}
-
-	int dim = dir / 2;
-	bool positive = (dir % 2 == 1);
+// Remove the labels in cell A that have no support in cell B, where A is the
+// neighbor of B in the direction.
+void PropagatorAc3::revise(int cellA, int cellB, int dir) {
+	// A label remains possible if any of its compatible labels are possible in B.
 	for (int a = 0; a < numLabels; a++) {
-		if (possibleLabels[xA][yA][zA][a]) {
-			bool acceptable = false;
-			for (int b = 0; b < numLabels; b++) {
-				bool validTransition = positive ? transition[dim][b][a] : transition[dim][a][b];
-				if (validTransition && possibleLabels[xB][yB][zB][b]) {
-					acceptable = true;
-					break;
-				}
-			}
+		if (domain->isPossible(cellA, a)) {
+			bool acceptable = domain->intersects(cellB, compatibleMask(dir, a));
 			if (!acceptable) {
-				possibleLabels[xA][yA][zA][a] = false;
-				if (!inQueue[xA][yA][zA]) {
-					int* posA = new int[3];
-					posA[0] = xA;
-					posA[1] = yA;
-					posA[2] = zA;
-					updateQueue.push_back(posA);
+				domain->remove(cellA, a);
+				if (!inQueue[cellA]) {
+					updateQueue->push(cellA);
+					inQueue[cellA] = true;
 				}
 			}
 		}
 	}
 }
+
+// Returns a checkpoint of the current state.
+int PropagatorAc3::checkpoint() {
+	return domain->trailSize();
+}
+
+// Undo every change made since the checkpoint.
+void PropagatorAc3::rollback(int checkpoint) {
+	domain->rollback(checkpoint);
+}
+
+// Save the current state so it can be restored without recomputing it.
+void PropagatorAc3::saveSnapshot() {
+	domain->saveSnapshot();
+}
+
+// Restore the state saved by saveSnapshot.
+void PropagatorAc3::restoreSnapshot() {
+	domain->restoreSnapshot();
+}
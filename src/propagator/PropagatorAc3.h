@@ -2,21 +2,44 @@
 #ifndef PROPAGATOR_AC_3
 #define PROPAGATOR_AC_3
 
-#include <deque>
 #include "Propagator.h"
+#include "BitsetDomain.h"
+#include "RingBuffer.h"
+#include "BlockBounds.h"
 
 class PropagatorAc3 : public Propagator {
 	private:
 		InputSettings* settings;
-		bool**** possibleLabels;
-		bool*** inQueue;
+		// The cells whose neighbors need to be revised, and whether each cell
+		// is already waiting in the queue.
+		RingBuffer<int>* updateQueue;
+		bool* inQueue;
 		int* possibilitySize;
 		int* size;
 		int* offset;
 		int numLabels;
 
-		// Propagate the existing labels in a particular direction.
-		void propagate(int x, int y, int z, int dir, std::deque<int*>& updateQueue);
+		// compatible[dir][a] is a row of bits with the labels b that support
+		// label a when b is in the neighboring cell in direction dir.
+		uint64_t* compatible;
+
+		// Returns the mask of labels that support the label in the direction.
+		inline const uint64_t* compatibleMask(int dir, int label) const {
+			return compatible + ((size_t)dir * numLabels + label) * domain->getWordsPerCell();
+		}
+
+		// Remove the labels in cell A with no support in its neighbor B.
+		void revise(int cellA, int cellB, int dir);
+
+		// Propagate until the update queue is empty.
+		bool propagateQueue();
+
+		// The version of propagateQueueIn for this number of dimensions and
+		// periodicity. This is chosen once when the propagator is created.
+		bool (PropagatorAc3::*propagateFunction)();
+
+		template <int NumDims, bool Periodic>
+		bool propagateQueueIn();
 
 	public:
 		PropagatorAc3(InputSettings* newSettings, int* newPossibilitySize, int* newOffset);
@@ -33,6 +56,18 @@ class PropagatorAc3 : public Propagator {
 
 		// Returns true if the label at this location is possible.
 		bool isPossible(int x, int y, int z, int label);
+
+		// Returns a checkpoint of the current state.
+		int checkpoint();
+
+		// Undo every change made since the checkpoint.
+		void rollback(int checkpoint);
+
+		// Save the current state so it can be restored without recomputing it.
+		void saveSnapshot();
+
+		// Restore the state saved by saveSnapshot.
+		void restoreSnapshot();
 };
 
 #endif // PROPAGATOR_AC_3
@@ -2,6 +2,8 @@
 #include "PropagatorAc4.h"
 #include <vector>
 #include <iostream>
+#include <cstdint>
+#include <cstring>
 
 PropagatorAc4::PropagatorAc4(
 	InputSettings* newSettings,
@@ -15,115 +17,155 @@ PropagatorAc4::PropagatorAc4(
 	size = settings->size;
 	numDirections = 2 * settings->numDims;
 
-	possibleLabels = new bool*** [possibilitySize[0]];
-	for (int x = 0; x < possibilitySize[0]; x++) {
-		possibleLabels[x] = new bool** [possibilitySize[1]];
-		for (int y = 0; y < possibilitySize[1]; y++) {
-			possibleLabels[x][y] = new bool* [possibilitySize[2]];
-			for (int z = 0; z < possibilitySize[2]; z++) {
-				possibleLabels[x][y][z] = new bool[numLabels];
-			}
-		}
+	domain = new BitsetDomain(possibilitySize, numLabels, settings->weights.data());
+
+	// Use the narrowest counters that can hold the largest support count.
+	if (settings->maxSupportCount <= UINT8_MAX) {
+		supportWidth = sizeof(uint8_t);
+	} else if (settings->maxSupportCount <= UINT16_MAX) {
+		supportWidth = sizeof(uint16_t);
+	} else {
+		supportWidth = sizeof(uint32_t);
 	}
-	support = new int**** [possibilitySize[0]];
-	for (int x = 0; x < possibilitySize[0]; x++) {
-		support[x] = new int*** [possibilitySize[1]];
-		for (int y = 0; y < possibilitySize[1]; y++) {
-			support[x][y] = new int** [possibilitySize[2]];
-			for (int z = 0; z < possibilitySize[2]; z++) {
-				support[x][y][z] = new int* [numLabels];
-				for (int i = 0; i < numLabels; i++) {
-					support[x][y][z][i] = new int[numDirections];
-				}
-			}
+	size_t countsPerCell = (size_t)numDirections * numLabels;
+	support = new uint8_t[domain->getNumCells() * countsPerCell * supportWidth];
+	initialSupport = new uint8_t[countsPerCell * supportWidth];
+	supportStamps = new uint32_t[domain->getNumCells()]();
+	snapshotSupport = nullptr;
+	snapshotSupportStamps = nullptr;
+	updateQueue = new RingBuffer<LabelRemoval>(domain->getNumCells());
+	numPropagated = 0;
+	domain->setTrailing(settings->backtrackDepth > 0);
+	bounds = new BlockBounds(possibilitySize, offset, size, settings->periodic);
+	switch (supportWidth) {
+		case sizeof(uint8_t): chooseFunctions<uint8_t>(); break;
+		case sizeof(uint16_t): chooseFunctions<uint16_t>(); break;
+		default: chooseFunctions<uint32_t>(); break;
+	}
+}
+
+PropagatorAc4::~PropagatorAc4() {
+	delete[] (uint8_t*)support;
+	delete[] (uint8_t*)initialSupport;
+	delete[] supportStamps;
+	delete[] (uint8_t*)snapshotSupport;
+	delete[] snapshotSupportStamps;
+	delete updateQueue;
+	delete bounds;
+	delete domain;
+}
+
+// Copy the support counts from the settings into the counters for one cell.
+template <typename Count>
+void PropagatorAc4::fillInitialSupport() {
+	Count* counts = (Count*)initialSupport;
+	for (int dir = 0; dir < numDirections; dir++) {
+		for (int label = 0; label < numLabels; label++) {
+			counts[dir * numLabels + label] = (Count)settings->supportCount[label][dir];
 		}
 	}
 }
 
-void addToQueue(int x, int y, int z, int label, std::deque<vector<int>>& updateQueue) {
-	vector<int> labeledPos(4);
-	labeledPos[0] = x;
-	labeledPos[1] = y;
-	labeledPos[2] = z;
-	labeledPos[3] = label;
-	updateQueue.push_back(labeledPos);
-}
-
-// Propagate everything in the update queue.
-void PropagatorAc4::propagate(deque<vector<int>>& updateQueue) {
-	while (updateQueue.size() > 0) {
-		vector<int> update = updateQueue.front();
-		int xC = update[0];
-		int yC = update[1];
-		int zC = update[2];
-
-		vector<vector<int>> cSupporting = settings->supporting[update[3]];
-		for (int dir = 0; dir < numDirections; dir++) {
-			int xB = xC;
-			int yB = yC;
-			int zB = zC;
-			switch (dir) {
-			case 0: xB--; break;
-			case 1: xB++; break;
-			case 2: yB--; break;
-			case 3: yB++; break;
-			case 4: zB--; break;
-			case 5: zB++; break;
-			}
-			// Do not propagate if this goes outside the bounds of the block.
-			if (settings->periodic) {
-				switch (dir) {
-				case 0: if (xB < offset[0]) { xB += size[0]; } break;
-				case 2: if (yB < offset[1]) { yB += size[1]; } break;
-				case 4: if (zB <= offset[2]) { continue; } break;
-				case 1: if (xB > possibilitySize[0] - offset[0] - 1) { xB -= size[0]; } break;
-				case 3: if (yB > possibilitySize[1] - offset[1] - 1) { yB -= size[1]; } break;
-				case 5: if (zB > possibilitySize[2] - offset[2] - 1) { continue; } break;
-				}
-			}
-			else {
-				switch (dir) {
-				case 0: if (xC <= offset[0]) { continue; } break;
-				case 2: if (yC <= offset[1]) { continue; } break;
-				case 4: if (zC <= offset[2]) { continue; } break;
-				case 1: if (xC >= possibilitySize[0] - offset[0] - 1) { continue; } break;
-				case 3: if (yC >= possibilitySize[1] - offset[1] - 1) { continue; } break;
-				case 5: if (zC >= possibilitySize[2] - offset[2] - 1) { continue; } break;
-				}
+// Fill in the initial support and choose the propagation functions for the
+// counter type.
+template <typename Count>
+void PropagatorAc4::chooseFunctions() {
+	fillInitialSupport<Count>();
+	if (settings->numDims == 2) {
+		chooseFunctions<Count, 2>();
+	} else {
+		chooseFunctions<Count, 3>();
+	}
+}
+
+template <typename Count, int NumDims>
+void PropagatorAc4::chooseFunctions() {
+	if (settings->periodic) {
+		propagateFunction = &PropagatorAc4::propagateCounts<Count, NumDims, true>;
+		restoreFunction = &PropagatorAc4::restoreCounts<Count, NumDims, true>;
+	} else {
+		propagateFunction = &PropagatorAc4::propagateCounts<Count, NumDims, false>;
+		restoreFunction = &PropagatorAc4::restoreCounts<Count, NumDims, false>;
+	}
+}
+
+// Propagate everything in the update queue. Returns false if a cell has no
+// possible labels left.
+bool PropagatorAc4::propagate() {
+	return (this->*propagateFunction)();
+}
+
+// The support counters for every direction and label of the cell. The
+// counters are reset the first time they are used after resetBlock.
+template <typename Count>
+Count* PropagatorAc4::cellSupport(int cell) {
+	size_t countsPerCell = (size_t)numDirections * numLabels;
+	Count* counts = (Count*)support + cell * countsPerCell;
+	if (supportStamps[cell] != domain->getEpoch()) {
+		memcpy(counts, initialSupport, countsPerCell * sizeof(Count));
+		supportStamps[cell] = domain->getEpoch();
+	}
+	return counts;
+}
+
+template <typename Count, int NumDims, bool Periodic>
+bool PropagatorAc4::propagateCounts() {
+	bool failed = false;
+	while (!updateQueue->empty()) {
+		LabelRemoval update = updateQueue->pop();
+		int xC, yC, zC;
+		domain->position(update.cell, xC, yC, zC);
+
+		const vector<vector<int>>& cSupporting = settings->supporting[update.label];
+		for (int dir = 0; dir < 2 * NumDims; dir++) {
+			int xB, yB, zB;
+			if (!bounds->neighbor<NumDims, Periodic>(xC, yC, zC, dir, xB, yB, zB)) {
+				continue;
 			}
-			vector<int> dirSupporting = cSupporting[dir];
-			for (int i = 0; i < (int)dirSupporting.size(); i++) {
+			int cellB = domain->index(xB, yB, zB);
+			Count* cellCounts = cellSupport<Count>(cellB) + dir * numLabels;
+			const vector<int>& dirSupporting = cSupporting[dir];
+			int numSupporting = (int)dirSupporting.size();
+			for (int i = 0; i < numSupporting; i++) {
 				int b = dirSupporting[i];
-				support[xB][yB][zB][b][dir]--;
-				if (support[xB][yB][zB][b][dir] == 0 && possibleLabels[xB][yB][zB][b]) {
-					possibleLabels[xB][yB][zB][b] = false;
-					addToQueue(xB, yB, zB, b, updateQueue);
+				cellCounts[b]--;
+				if (cellCounts[b] == 0 && domain->isPossible(cellB, b)) {
+					domain->remove(cellB, b);
+					updateQueue->push({ cellB, b });
+					if (domain->count(cellB) == 0) {
+						failed = true;
+					}
 				}
 			}
 		}
-		updateQueue.pop_front();
+		numPropagated++;
+
+		// Stop as soon as a cell is empty. The removal is finished first so
+		// that the first numPropagated removals on the trail are exactly the
+		// ones the counters reflect, which rollback relies on.
+		if (failed) {
+			updateQueue->clear();
+			return false;
+		}
 	}
+	return true;
 }
 
 // Set a label in the block at the given position.
 bool PropagatorAc4::setBlockLabel(int label, int position[3]) {
-	std::deque<vector<int>> updateQueue;
 	int x = position[0];
 	int y = position[1];
 	int z = position[2];
+	int cell = domain->index(x, y, z);
 	for (int i = 0; i < numLabels; i++) {
-		if (i != label && possibleLabels[x][y][z][i]) {
-			vector<int> labeledPos(4);
-			possibleLabels[x][y][z][i] = false;
-			labeledPos[0] = x;
-			labeledPos[1] = y;
-			labeledPos[2] = z;
-			labeledPos[3] = i;
-			updateQueue.push_back(labeledPos);
+		if (i != label && domain->isPossible(cell, i)) {
+			domain->remove(cell, i);
+			updateQueue->push({ cell, i });
 		}
 	}
-	propagate(updateQueue);
-	return true;
+	// The label may already have been removed, leaving the cell empty.
+	bool success = propagate();
+	return success && domain->isPossible(cell, label);
 }
 
 // Remove a label in the block at the given position.
@@ -131,35 +173,88 @@ bool PropagatorAc4::removeLabel(int label, int position[3]) {
 	int x = position[0];
 	int y = position[1];
 	int z = position[2];
-	possibleLabels[x][y][z][label] = false;
-	vector<int> labeledPos(4);
-	labeledPos[0] = x;
-	labeledPos[1] = y;
-	labeledPos[2] = z;
-	labeledPos[3] = label;
-	std::deque<vector<int>> updateQueue;
-	updateQueue.push_back(labeledPos);
-	propagate(updateQueue);
-	return true;
+	int cell = domain->index(x, y, z);
+	if (!domain->isPossible(cell, label)) {
+		return true;
+	}
+	domain->remove(cell, label);
+	updateQueue->push({ cell, label });
+	bool success = propagate();
+	return success && domain->count(cell) > 0;
 }
 
 // Set a label in the block at the given position.
 void PropagatorAc4::resetBlock() {
-	for (int x = 0; x < possibilitySize[0]; x++) {
-		for (int y = 0; y < possibilitySize[1]; y++) {
-			for (int z = 0; z < possibilitySize[2]; z++) {
-				for (int label = 0; label < numLabels; label++) {
-					possibleLabels[x][y][z][label] = true;
-					for (int dir = 0; dir < numDirections; dir++) {
-						support[x][y][z][label][dir] = settings->supportCount[label][dir];
-					}
-				}
-			}
-		}
+	// The domain and the counters are both reset lazily as cells are used.
+	domain->reset();
+	if (domain->getEpoch() == 1) {
+		// The epoch wrapped around.
+		memset(supportStamps, 0, domain->getNumCells() * sizeof(uint32_t));
 	}
+	numPropagated = 0;
 }
 
 // Set a label in the block at the given position.
 bool PropagatorAc4::isPossible(int x, int y, int z, int label) {
-	return possibleLabels[x][y][z][label];
+	return domain->isPossible(domain->index(x, y, z), label);
+}
+
+// Returns a checkpoint of the current state.
+int PropagatorAc4::checkpoint() {
+	return domain->trailSize();
+}
+
+// Undo every change made since the checkpoint. The removals on the trail are
+// in the same order they were propagated, so the support counters can be
+// restored by walking back over the removals that were propagated.
+void PropagatorAc4::rollback(int checkpoint) {
+	updateQueue->clear();
+	(this->*restoreFunction)(checkpoint);
+	domain->rollback(checkpoint);
+	numPropagated = min(numPropagated, checkpoint);
+}
+
+template <typename Count, int NumDims, bool Periodic>
+void PropagatorAc4::restoreCounts(int checkpoint) {
+	for (int i = numPropagated - 1; i >= checkpoint; i--) {
+		const LabelRemoval& removal = domain->trailEntry(i);
+		int xC, yC, zC;
+		domain->position(removal.cell, xC, yC, zC);
+		const vector<vector<int>>& cSupporting = settings->supporting[removal.label];
+		for (int dir = 0; dir < 2 * NumDims; dir++) {
+			int xB, yB, zB;
+			if (!bounds->neighbor<NumDims, Periodic>(xC, yC, zC, dir, xB, yB, zB)) {
+				continue;
+			}
+			int cellB = domain->index(xB, yB, zB);
+			Count* cellCounts = cellSupport<Count>(cellB) + dir * numLabels;
+			for (int b : cSupporting[dir]) {
+				cellCounts[b]++;
+			}
+		}
+	}
+}
+
+// Save the current state so it can be restored without recomputing it.
+void PropagatorAc4::saveSnapshot() {
+	int numCells = domain->getNumCells();
+	size_t supportBytes = (size_t)numCells * numDirections * numLabels * supportWidth;
+	if (snapshotSupport == nullptr) {
+		snapshotSupport = new uint8_t[supportBytes];
+		snapshotSupportStamps = new uint32_t[numCells];
+	}
+	memcpy(snapshotSupport, support, supportBytes);
+	memcpy(snapshotSupportStamps, supportStamps, numCells * sizeof(uint32_t));
+	domain->saveSnapshot();
+}
+
+// Restore the state saved by saveSnapshot.
+void PropagatorAc4::restoreSnapshot() {
+	int numCells = domain->getNumCells();
+	size_t supportBytes = (size_t)numCells * numDirections * numLabels * supportWidth;
+	memcpy(support, snapshotSupport, supportBytes);
+	memcpy(supportStamps, snapshotSupportStamps, numCells * sizeof(uint32_t));
+	domain->restoreSnapshot();
+	updateQueue->clear();
+	numPropagated = 0;
 }
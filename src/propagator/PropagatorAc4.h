@@ -2,25 +2,73 @@
 #ifndef PROPAGATOR_AC_4
 #define PROPAGATOR_AC_4
 
-#include <deque>
 #include <vector>
 #include "Propagator.h"
+#include "BitsetDomain.h"
+#include "RingBuffer.h"
+#include "BlockBounds.h"
 
 using namespace std;
 
 class PropagatorAc4 : public Propagator {
 	private:
 		InputSettings* settings;
-		bool**** possibleLabels;
-		int***** support;
+		// The number of labels supporting each label in each direction. This
+		// is stored as [cell][dir][label] using counters that are supportWidth
+		// bytes wide.
+		void* support;
+		// The initial support counts for a single cell.
+		void* initialSupport;
+		int supportWidth;
+		// The domain epoch each cell's counters were last written in. Counters
+		// from an older epoch are reset from initialSupport when next used.
+		uint32_t* supportStamps;
+		// The counters and stamps saved by saveSnapshot.
+		void* snapshotSupport;
+		uint32_t* snapshotSupportStamps;
+		// The removed labels waiting to be propagated. This is reused by every
+		// propagation.
+		RingBuffer<LabelRemoval>* updateQueue;
+		// The number of removals on the trail whose propagation has finished.
+		int numPropagated;
 		int* possibilitySize;
 		int* offset;
 		int* size;
 		int numLabels;
 		int numDirections;
 
-		// Propagate the existing labels.
-		void propagate(std::deque<vector<int>>& updateQueue);
+		// The versions of propagateCounts and restoreCounts for this counter
+		// width, number of dimensions and periodicity. These are chosen once
+		// when the propagator is created.
+		bool (PropagatorAc4::*propagateFunction)();
+		void (PropagatorAc4::*restoreFunction)(int checkpoint);
+
+		// Choose propagateFunction and restoreFunction.
+		template <typename Count>
+		void chooseFunctions();
+
+		template <typename Count, int NumDims>
+		void chooseFunctions();
+
+		// Propagate the labels in the update queue. Returns false as soon as
+		// a cell has no possible labels left.
+		bool propagate();
+
+		// Propagate using support counters of the given type.
+		template <typename Count, int NumDims, bool Periodic>
+		bool propagateCounts();
+
+		// The support counters for every direction and label of the cell.
+		template <typename Count>
+		Count* cellSupport(int cell);
+
+		// Add back the support that propagating the removals removed.
+		template <typename Count, int NumDims, bool Periodic>
+		void restoreCounts(int checkpoint);
+
+		// Set the initial support counts using counters of the given type.
+		template <typename Count>
+		void fillInitialSupport();
 
 	public:
 		PropagatorAc4(InputSettings* newSettings, int* newPossibilitySize, int* newOffset);
@@ -37,6 +85,18 @@ class PropagatorAc4 : public Propagator {
 
 		// Returns true if the label at this location is possible.
 		bool isPossible(int x, int y, int z, int label);
+
+		// Returns a checkpoint of the current state.
+		int checkpoint();
+
+		// Undo every change made since the checkpoint.
+		void rollback(int checkpoint);
+
+		// Save the current state so it can be restored without recomputing it.
+		void saveSnapshot();
+
+		// Restore the state saved by saveSnapshot.
+		void restoreSnapshot();
 };
 
 #endif // PROPAGATOR_AC_4
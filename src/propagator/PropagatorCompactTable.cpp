@@ -0,0 +1,233 @@
+// Copyright (c) 2021 Paul Merrell
+#include "PropagatorCompactTable.h"
+#include <cstring>
+
+PropagatorCompactTable::PropagatorCompactTable(
+	InputSettings* newSettings,
+	int* newPossibilitySize,
+	int* newOffset
+) : Propagator(newSettings) {
+	settings = newSettings;
+	possibilitySize = newPossibilitySize;
+	offset = newOffset;
+	numLabels = settings->numLabels;
+	size = settings->size;
+
+	domain = new BitsetDomain(possibilitySize, numLabels, settings->weights.data());
+	wordsPerCell = domain->getWordsPerCell();
+	compatible = createCompatibleMasks(*settings, wordsPerCell);
+	supported = new uint64_t[wordsPerCell];
+
+	int numCells = domain->getNumCells();
+	nonZero = new int[(size_t)numCells * wordsPerCell];
+	for (int cell = 0; cell < numCells; cell++) {
+		for (int i = 0; i < wordsPerCell; i++) {
+			nonZero[(size_t)cell * wordsPerCell + i] = i;
+		}
+	}
+	nonZeroCount = new int[numCells];
+	nonZeroStamps = new uint32_t[numCells]();
+
+	// Each cell is in the queue at most once, so the queue never needs to grow.
+	inQueue = new bool[numCells]();
+	updateQueue = new RingBuffer<int>(numCells);
+	domain->setTrailing(settings->backtrackDepth > 0);
+
+	// Choose the propagation loop for the number of dimensions and periodicity.
+	bounds = new BlockBounds(possibilitySize, offset, size, settings->periodic);
+	if (settings->numDims == 2) {
+		propagateFunction = settings->periodic ? &PropagatorCompactTable::propagateQueueIn<2, true> : &PropagatorCompactTable::propagateQueueIn<2, false>;
+	} else {
+		propagateFunction = settings->periodic ? &PropagatorCompactTable::propagateQueueIn<3, true> : &PropagatorCompactTable::propagateQueueIn<3, false>;
+	}
+}
+
+PropagatorCompactTable::~PropagatorCompactTable() {
+	delete[] inQueue;
+	delete updateQueue;
+	delete bounds;
+	delete[] compatible;
+	delete[] supported;
+	delete[] nonZero;
+	delete[] nonZeroCount;
+	delete[] nonZeroStamps;
+	delete domain;
+}
+
+// Mark every word in the cell as possibly non-zero. The order of the words
+// does not matter, so only the count needs to change.
+void PropagatorCompactTable::resetNonZero(int cell) {
+	nonZeroCount[cell] = wordsPerCell;
+	nonZeroStamps[cell] = domain->getEpoch();
+}
+
+// Propagate the changes from every cell in the update queue. Returns false
+// if a cell has no possible labels left.
+bool PropagatorCompactTable::propagateQueue() {
+	return (this->*propagateFunction)();
+}
+
+template <int NumDims, bool Periodic>
+bool PropagatorCompactTable::propagateQueueIn() {
+	while (!updateQueue->empty()) {
+		int cell = updateQueue->pop();
+		inQueue[cell] = false;
+
+		int x, y, z;
+		domain->position(cell, x, y, z);
+		for (int dir = 0; dir < 2 * NumDims; dir++) {
+			int xA, yA, zA;
+			if (bounds->neighbor<NumDims, Periodic>(x, y, z, dir, xA, yA, zA)) {
+				if (!update(domain->index(xA, yA, zA), cell, dir)) {
+					while (!updateQueue->empty()) {
+						inQueue[updateQueue->pop()] = false;
+					}
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// Remove the labels in cell A that have no support in cell B, where A is the
+// neighbor of B in the direction. Returns false if cell A has no labels left.
+bool PropagatorCompactTable::update(int cellA, int cellB, int dir) {
+	int count = getNonZeroCount(cellA);
+	if (count == 0) {
+		return false;
+	}
+	int* wordsA = nonZero + (size_t)cellA * wordsPerCell;
+	const uint64_t* rowA = domain->row(cellA);
+	for (int k = 0; k < count; k++) {
+		supported[wordsA[k]] = 0;
+	}
+
+	// OR together the support of every label possible in B, but only on the
+	// non-zero words of A. Stop early once every label in A is supported.
+	const uint64_t* rowB = domain->row(cellB);
+	for (int j = 0; j < wordsPerCell; j++) {
+		uint64_t word = rowB[j];
+		while (word) {
+			int b = 64 * j + countTrailingZeros(word);
+			word &= word - 1;
+			const uint64_t* mask = supportMask(dir, b);
+			uint64_t unsupported = 0;
+			for (int k = 0; k < count; k++) {
+				int i = wordsA[k];
+				supported[i] |= mask[i];
+				unsupported |= rowA[i] & ~supported[i];
+			}
+			if (unsupported == 0) {
+				return true;
+			}
+		}
+	}
+
+	// Remove the unsupported labels. Words that become zero are swapped past
+	// the end of the non-zero words.
+	bool changed = false;
+	for (int k = count - 1; k >= 0; k--) {
+		int i = wordsA[k];
+		uint64_t removed = domain->row(cellA)[i] & ~supported[i];
+		if (removed == 0) {
+			continue;
+		}
+		domain->removeBits(cellA, i, removed);
+		changed = true;
+		if (domain->row(cellA)[i] == 0) {
+			count--;
+			wordsA[k] = wordsA[count];
+			wordsA[count] = i;
+		}
+	}
+	if (!changed) {
+		return true;
+	}
+	nonZeroCount[cellA] = count;
+	nonZeroStamps[cellA] = domain->getEpoch();
+	if (count == 0) {
+		return false;
+	}
+	if (!inQueue[cellA]) {
+		updateQueue->push(cellA);
+		inQueue[cellA] = true;
+	}
+	return true;
+}
+
+// Remove a label in the block at the given position.
+bool PropagatorCompactTable::removeLabel(int label, int position[3]) {
+	int cell = domain->index(position[0], position[1], position[2]);
+	if (!domain->isPossible(cell, label)) {
+		return true;
+	}
+	domain->remove(cell, label);
+	if (!domain->any(cell)) {
+		return false;
+	}
+	updateQueue->push(cell);
+	inQueue[cell] = true;
+	return propagateQueue();
+}
+
+// Set a label in the block at the given position.
+bool PropagatorCompactTable::setBlockLabel(int label, int position[3]) {
+	int cell = domain->index(position[0], position[1], position[2]);
+	domain->setOnly(cell, label);
+	// Only the word with the label is non-zero now.
+	int* words = nonZero + (size_t)cell * wordsPerCell;
+	for (int k = 0; k < wordsPerCell; k++) {
+		if (words[k] == label >> 6) {
+			words[k] = words[0];
+			words[0] = label >> 6;
+			break;
+		}
+	}
+	nonZeroCount[cell] = 1;
+	nonZeroStamps[cell] = domain->getEpoch();
+	updateQueue->push(cell);
+	inQueue[cell] = true;
+	return propagateQueue();
+}
+
+// Reset the block to include all possible labels.
+void PropagatorCompactTable::resetBlock() {
+	domain->reset();
+	if (domain->getEpoch() == 1) {
+		// The epoch wrapped around.
+		memset(nonZeroStamps, 0, domain->getNumCells() * sizeof(uint32_t));
+	}
+}
+
+// Returns true if the label at this location is possible.
+bool PropagatorCompactTable::isPossible(int x, int y, int z, int label) {
+	return domain->isPossible(domain->index(x, y, z), label);
+}
+
+// Returns a checkpoint of the current state.
+int PropagatorCompactTable::checkpoint() {
+	return domain->trailSize();
+}
+
+// Undo every change made since the checkpoint. A word that was zero may have
+// labels again, so every word of a changed cell is marked as non-zero. The
+// zero words are dropped again the next time the cell is updated.
+void PropagatorCompactTable::rollback(int checkpoint) {
+	for (int i = checkpoint; i < domain->trailSize(); i++) {
+		resetNonZero(domain->trailEntry(i).cell);
+	}
+	domain->rollback(checkpoint);
+}
+
+// Save the current state so it can be restored without recomputing it.
+void PropagatorCompactTable::saveSnapshot() {
+	domain->saveSnapshot();
+}
+
+// Restore the state saved by saveSnapshot. The non-zero words are not part
+// of the snapshot, so every word of every cell is marked as non-zero.
+void PropagatorCompactTable::restoreSnapshot() {
+	domain->restoreSnapshot();
+	memset(nonZeroStamps, 0, domain->getNumCells() * sizeof(uint32_t));
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2021 Paul Merrell
+#ifndef PROPAGATOR_COMPACT_TABLE
+#define PROPAGATOR_COMPACT_TABLE
+
+#include "Propagator.h"
+#include "BitsetDomain.h"
+#include "RingBuffer.h"
+#include "BlockBounds.h"
+
+// Propagates labels using the compact-table idea (Demeulenaere et al., 2016)
+// for the binary constraints between neighboring cells. When a cell changes,
+// the labels its neighbor may keep are found by OR-ing together the
+// precomputed support rows of every label still possible in the cell, and
+// the neighbor's row is ANDed with the result. This works on whole words of
+// labels at a time, so it scales to rulesets with thousands of labels.
+//
+// Each cell is a reversible sparse bitset: besides its row of bits it keeps
+// the indices of its non-zero words, and only those words are visited.
+class PropagatorCompactTable : public Propagator {
+	private:
+		InputSettings* settings;
+		// The cells whose neighbors need to be updated, and whether each cell
+		// is already waiting in the queue.
+		RingBuffer<int>* updateQueue;
+		bool* inQueue;
+		int* possibilitySize;
+		int* size;
+		int* offset;
+		int numLabels;
+		int wordsPerCell;
+
+		// compatible[dir][b] is a row of bits with the labels a that are
+		// supported by label b when a is in the neighboring cell in the
+		// opposite direction of dir.
+		uint64_t* compatible;
+
+		// The indices of the words in each cell's row, stored as
+		// [cell][word]. The first nonZeroCount[cell] of them are the words
+		// that may be non-zero; the rest are known to be zero.
+		int* nonZero;
+		int* nonZeroCount;
+		// The epoch each cell's nonZeroCount was last written in. A cell with
+		// an old stamp has every word non-zero.
+		uint32_t* nonZeroStamps;
+
+		// The labels supported in the neighbor being updated.
+		uint64_t* supported;
+
+		// Returns the labels in the neighbor of a cell in direction dir that
+		// are supported by the label in the cell.
+		inline const uint64_t* supportMask(int dir, int label) const {
+			return compatible + ((size_t)(dir ^ 1) * numLabels + label) * wordsPerCell;
+		}
+
+		// The number of words in the cell that may be non-zero.
+		inline int getNonZeroCount(int cell) const {
+			return nonZeroStamps[cell] == domain->getEpoch() ? nonZeroCount[cell] : wordsPerCell;
+		}
+
+		// Mark every word in the cell as possibly non-zero.
+		void resetNonZero(int cell);
+
+		// Remove the labels in cell A with no support in its neighbor B.
+		// Returns false if cell A has no labels left.
+		bool update(int cellA, int cellB, int dir);
+
+		// Propagate until the update queue is empty.
+		bool propagateQueue();
+
+		// The version of propagateQueueIn for this number of dimensions and
+		// periodicity. This is chosen once when the propagator is created.
+		bool (PropagatorCompactTable::*propagateFunction)();
+
+		template <int NumDims, bool Periodic>
+		bool propagateQueueIn();
+
+	public:
+		PropagatorCompactTable(InputSettings* newSettings, int* newPossibilitySize, int* newOffset);
+		~PropagatorCompactTable();
+
+		// Set a label in the block at the given position.
+		bool setBlockLabel(int label, int position[3]);
+
+		// Remove a label from the given position.
+		bool removeLabel(int label, int position[3]);
+
+		// Reset the block to include all possible labels.
+		void resetBlock();
+
+		// Returns true if the label at this location is possible.
+		bool isPossible(int x, int y, int z, int label);
+
+		// Returns a checkpoint of the current state.
+		int checkpoint();
+
+		// Undo every change made since the checkpoint.
+		void rollback(int checkpoint);
+
+		// Save the current state so it can be restored without recomputing it.
+		void saveSnapshot();
+
+		// Restore the state saved by saveSnapshot.
+		void restoreSnapshot();
+};
+
+#endif // PROPAGATOR_COMPACT_TABLE
@@ -0,0 +1,85 @@
+// Copyright (c) 2021 Paul Merrell
+#ifndef RING_BUFFER
+#define RING_BUFFER
+
+#include <cstring>
+
+// A first-in first-out queue stored in a circular array. The array only
+// grows when the queue is full, so once it has reached its working size,
+// pushing and popping never allocate memory.
+template <typename T>
+class RingBuffer {
+	private:
+		T* items;
+		int capacity;
+		int head;
+		int count;
+
+		// Double the capacity, moving the items to the start of the array.
+		void grow() {
+			T* newItems = new T[2 * capacity];
+			int firstPart = capacity - head;
+			if (firstPart > count) {
+				firstPart = count;
+			}
+			memcpy(newItems, items + head, firstPart * sizeof(T));
+			memcpy(newItems + firstPart, items, (count - firstPart) * sizeof(T));
+			delete[] items;
+			items = newItems;
+			capacity *= 2;
+			head = 0;
+		}
+
+	public:
+		RingBuffer(int initialCapacity) {
+			capacity = initialCapacity > 0 ? initialCapacity : 1;
+			items = new T[capacity];
+			head = 0;
+			count = 0;
+		}
+
+		~RingBuffer() {
+			delete[] items;
+		}
+
+		RingBuffer(const RingBuffer&) = delete;
+		RingBuffer& operator=(const RingBuffer&) = delete;
+
+		inline bool empty() const {
+			return count == 0;
+		}
+
+		inline int size() const {
+			return count;
+		}
+
+		inline void push(const T& item) {
+			if (count == capacity) {
+				grow();
+			}
+			int tail = head + count;
+			if (tail >= capacity) {
+				tail -= capacity;
+			}
+			items[tail] = item;
+			count++;
+		}
+
+		inline T pop() {
+			T item = items[head];
+			head++;
+			if (head == capacity) {
+				head = 0;
+			}
+			count--;
+			return item;
+		}
+
+		// Remove every item.
+		inline void clear() {
+			head = 0;
+			count = 0;
+		}
+};
+
+#endif // RING_BUFFER
@@ -1,7 +1,5 @@
 // Copyright (c) 2021 Paul Merrell
 #include "synthesizer.h"
-#include "propagator/PropagatorAc3.h"
-#include "propagator/PropagatorAc4.h"
 #include <deque>
 #include <vector>
 #include <iostream>
@@ -12,13 +10,27 @@ using namespace std::chrono;
 
 const int numAttempts = 20;
 
-Synthesizer::Synthesizer(InputSettings * newSettings, microseconds & synthesisTime) {
+// The most picks that can be undone in one attempt at a block.
+const int maxBacktracks = 1000;
+
+// Adaptive blocks are not split smaller than this along any dimension.
+const int minAdaptiveBlockSize = 4;
+
+// How many adaptive blocks in a row must succeed without being split before
+// the blocks grow again.
+const int growAfterSuccesses = 8;
+
+Synthesizer::Synthesizer(InputSettings * newSettings, microseconds & synthesisTime, bool inBatch) {
 	auto startTime = high_resolution_clock::now();
 	settings = newSettings;
 	size = settings->size;
 	blockSize = settings->blockSize;
 	numLabels = settings->numLabels;
 	offset = new int[3];
+	numSyntheses = 0;
+	seed = settings->seed;
+	numThreads = inBatch ? 1 : settings->numThreads;
+	speculativeAttempts = inBatch ? 1 : settings->speculativeAttempts;
 
 	for (int dim = 0; dim < 3; dim++) {
 		// If we are shifting the block along this dimension, we need to leave room for a boundary
@@ -31,7 +43,7 @@ Synthesizer::Synthesizer(InputSettings * newSettings, microseconds & synthesisTi
 			offset[dim] = 0;
 		}
 	}
-	int* possibilitySize = new int[3];
+	possibilitySize = new int[3];
 	for (int dim = 0; dim < 3; dim++) {
 		if (blockSize[dim] == size[dim]) {
 			possibilitySize[dim] = size[dim];
@@ -40,54 +52,103 @@ Synthesizer::Synthesizer(InputSettings * newSettings, microseconds & synthesisTi
 			possibilitySize[dim] = blockSize[dim] + 2;
 		}
 	}
-
-	if (settings->useAc4) {
-		propagator = new PropagatorAc4(newSettings, possibilitySize, offset);
-	} else {
-		propagator = new PropagatorAc3(newSettings, possibilitySize, offset);
+	for (int dim = 0; dim < 3; dim++) {
+		wraps[dim] = settings->periodic && dim < 2 && blockSize[dim] < size[dim];
 	}
 
-	// Create the model with the initial labels.
-	model = new int** [size[0]];
-	for (int x = 0; x < size[0]; x++) {
-		model[x] = new int* [size[1]];
-		for (int y = 0; y < size[1]; y++) {
-			model[x][y] = new int[size[2]];
-		}
+	// Create the model. The labels are stored in the same order the blocks
+	// are swept in, in memory or in the model file.
+	model = new LabelGrid(size, numLabels, AxisOrder::XYZ, inBatch ? "" : settings->modelFile);
+	fillInitialLabels();
+	region = nullptr;
+	splitLevel = 0;
+	successStreak = 0;
+
+	// Each thread needs its own propagator and picked block.
+	threadPool = nullptr;
+	int numStates = 1;
+	if (numThreads != 1) {
+		threadPool = new ThreadPool(numThreads);
+	} else if (speculativeAttempts > 1) {
+		threadPool = new ThreadPool(speculativeAttempts);
 	}
-	savedBlock = new int** [possibilitySize[0]];
-	for (int x = 0; x < possibilitySize[0]; x++) {
-		savedBlock[x] = new int* [possibilitySize[1]];
-		for (int y = 0; y < possibilitySize[1]; y++) {
-			savedBlock[x][y] = new int[possibilitySize[2]];
-		}
+	if (threadPool != nullptr) {
+		numStates = threadPool->getNumThreads();
+	}
+	for (int i = 0; i < numStates; i++) {
+		states.push_back(createState());
 	}
 
 	auto endTime = high_resolution_clock::now();
 	synthesisTime += duration_cast<microseconds>(endTime - startTime);
 }
 
+BlockState* Synthesizer::createState() {
+	BlockState* state = new BlockState();
+	state->propagator = createPropagator(settings, possibilitySize, offset);
+	state->pickedBlock = new LabelGrid(possibilitySize, numLabels, model->getOrder());
+	for (int dim = 0; dim < 3; dim++) {
+		state->blockSize[dim] = blockSize[dim];
+	}
+	state->canSplit = false;
+	state->hasSnapshot = false;
+	state->firstSuccess = nullptr;
+	state->attempt = 0;
+	return state;
+}
+
 Synthesizer::~Synthesizer() {
-	for (int x = 0; x < size[0]; x++) {
-		for (int y = 0; y < size[1]; y++) {
-			delete[] model[x][y];
-		}
-		delete[] model[x];
+	delete model;
+	delete threadPool;
+	for (BlockState* state : states) {
+		delete state->pickedBlock;
+		delete state->propagator;
+		delete state;
 	}
-	delete[] model;
-	delete propagator;
 }
 
-int*** Synthesizer::getModel() {
-	return model;
+void Synthesizer::setSeed(uint64_t newSeed) {
+	seed = newSeed;
+	numSyntheses = 0;
+	splitLevel = 0;
+	successStreak = 0;
+}
+
+const LabelGrid& Synthesizer::getModel() const {
+	return *model;
 }
 
-int setupStepValues(const int dim, const int step, const int* shifts, const int* maxBlockStart, bool* hasBoundary) {
+const map<array<int, 3>, int>& Synthesizer::getBlockSizeCounts() const {
+	return blockSizeCounts;
+}
+
+// Fill the model with the initial labels. With a ground plane, the last rows
+// lead down to the ground on the last row, so the blocks along the ground
+// read labels from the model that fit with it, like the ground layer in the
+// initial labels of a 3D model.
+void Synthesizer::fillInitialLabels() {
+	model->fillAlongZ(settings->initialLabels);
+	if (settings->ground < 0) {
+		return;
+	}
+	int numRows = min((int)settings->groundLabels.size(), size[1]);
+	for (int i = 0; i < numRows; i++) {
+		int y = size[1] - numRows + i;
+		int label = settings->groundLabels[settings->groundLabels.size() - numRows + i];
+		for (int x = 0; x < size[0]; x++) {
+			for (int z = 0; z < size[2]; z++) {
+				model->set(x, y, z, label);
+			}
+		}
+	}
+}
+
+int setupStepValues(const int dim, const int step, const int* shifts, const int* maxBlockStart, const bool* wraps, bool* hasBoundary) {
 	int value = step * shifts[dim];
-	hasBoundary[2 * dim] = (step > 0);
+	hasBoundary[2 * dim] = (step > 0) || wraps[dim];
 	if (value >= maxBlockStart[dim]) {
 		value = maxBlockStart[dim];
-		hasBoundary[2 * dim + 1] = false;
+		hasBoundary[2 * dim + 1] = wraps[dim];
 	}
 	else {
 		hasBoundary[2 * dim + 1] = true;
@@ -117,27 +178,160 @@ void printIteration(int blockStart, PrintMode printMode, int indentation, string
 
 void Synthesizer::synthesize(microseconds& synthesisTime) {
 	auto startTime = high_resolution_clock::now();
+	numSyntheses++;
+	// Adaptive blocks start at the block size in the settings in every
+	// model, so a model does not depend on the models before it.
+	splitLevel = 0;
+	successStreak = 0;
 
 	// Set the initial labels.
-	for (int x = 0; x < size[0]; x++) {
-		for (int y = 0; y < size[1]; y++) {
-			for (int z = 0; z < size[2]; z++) {
-				model[x][y][z] = settings->initialLabels[z];
-			}
-		}
-	}
+	fillInitialLabels();
 
 	// At each step, we shift the block by half the width of the block.
 	// Calculate how many steps are needed.
 	int shifts[3];
 	int numSteps[3];
 	int maxBlockStart[3];
-	int blockStart[3];
 	for (int dim = 0; dim < 3; dim++) {
 		shifts[dim] = max(blockSize[dim] / 2, 1);
 		numSteps[dim] = (int)ceil((size[dim] - blockSize[dim]) / ((float)shifts[dim])) + 1;
 		maxBlockStart[dim] = size[dim] - blockSize[dim];
 	}
+	bool modifyInBlocks = numSteps[0] > 1 || numSteps[1] > 1 || numSteps[2] > 1;
+	// The size of an adaptive block depends on every block before it in the
+	// sweep, so adaptive blocks are synthesized one at a time.
+	if (modifyInBlocks && numThreads != 1 && !settings->adaptiveBlocks) {
+		synthesizeInPhases(shifts, numSteps, maxBlockStart);
+	} else {
+		synthesizeSerially(shifts, numSteps, maxBlockStart);
+	}
+
+	auto endTime = high_resolution_clock::now();
+	synthesisTime += duration_cast<microseconds>(endTime - startTime);
+}
+
+bool Synthesizer::synthesizeRegion(const Region& newRegion, microseconds& synthesisTime) {
+	auto startTime = high_resolution_clock::now();
+	numSyntheses++;
+
+	region = &newRegion;
+	int boxSize[3];
+	for (int dim = 0; dim < 3; dim++) {
+		boxSize[dim] = region->end[dim] - region->start[dim];
+	}
+	regionPins.assign((size_t)boxSize[0] * boxSize[1] * boxSize[2], -1);
+	for (const PinnedLabel& pin : region->pins) {
+		int i[3];
+		bool inside = true;
+		for (int dim = 0; dim < 3; dim++) {
+			i[dim] = pin.position[dim] - region->start[dim];
+			inside = inside && i[dim] >= 0 && i[dim] < boxSize[dim];
+		}
+		if (inside) {
+			regionPins[((size_t)i[0] * boxSize[1] + i[1]) * boxSize[2] + i[2]] = pin.label;
+		}
+	}
+
+	// Find the block positions along each dimension. Blocks are shifted as
+	// in the sweep until one ends past the region, since the last cell of a
+	// block keeps its label unless it is on the edge of the model.
+	vector<int> blockStarts[3];
+	for (int dim = 0; dim < 3; dim++) {
+		int shift = max(blockSize[dim] / 2, 1);
+		int maxBlockStart = size[dim] - blockSize[dim];
+		int start = min(max(region->start[dim], 0), maxBlockStart);
+		while (true) {
+			blockStarts[dim].push_back(start);
+			if (start == maxBlockStart || start + blockSize[dim] - 1 >= region->end[dim]) {
+				break;
+			}
+			start = min(start + shift, maxBlockStart);
+		}
+	}
+
+	bool success = true;
+	for (int xStart : blockStarts[0]) {
+		for (int yStart : blockStarts[1]) {
+			for (int zStart : blockStarts[2]) {
+				int blockStart[3] = { xStart, yStart, zStart };
+				bool hasBoundary[6];
+				for (int dim = 0; dim < 3; dim++) {
+					hasBoundary[2 * dim] = blockStart[dim] > 0 || wraps[dim];
+					hasBoundary[2 * dim + 1] = blockStart[dim] < size[dim] - blockSize[dim] || wraps[dim];
+				}
+				if (size[2] > 1) {
+					hasBoundary[4] = true;
+					hasBoundary[5] = true;
+				}
+				if (speculativeAttempts > 1) {
+					success = synthesizeBlockSpeculatively(blockStart, hasBoundary, true) && success;
+				} else {
+					success = synthesizeBlockWithRetries(*states[0], blockStart, hasBoundary, true) && success;
+				}
+			}
+		}
+	}
+
+	// The snapshots hold the fixed cells, so they can not be used to
+	// synthesize the whole model.
+	for (BlockState* state : states) {
+		state->hasSnapshot = false;
+	}
+	region = nullptr;
+
+	auto endTime = high_resolution_clock::now();
+	synthesisTime += duration_cast<microseconds>(endTime - startTime);
+	return success;
+}
+
+void Synthesizer::setModel(const LabelGrid& labels) {
+	int start[3] = { 0, 0, 0 };
+	model->copyBlock(labels, start, start, size);
+}
+
+int Synthesizer::fixedLabel(const int position[3]) const {
+	int i[3];
+	int boxSize[3];
+	for (int dim = 0; dim < 3; dim++) {
+		i[dim] = position[dim] - region->start[dim];
+		boxSize[dim] = region->end[dim] - region->start[dim];
+		if (i[dim] < 0 || i[dim] >= boxSize[dim]) {
+			return model->get(position);
+		}
+	}
+	size_t index = ((size_t)i[0] * boxSize[1] + i[1]) * boxSize[2] + i[2];
+	if (regionPins[index] >= 0) {
+		return regionPins[index];
+	}
+	if (!region->mask.empty() && !region->mask[index]) {
+		return model->get(position);
+	}
+	return -1;
+}
+
+bool Synthesizer::addFixedLabels(BlockState& state, int blockStart[3]) {
+	int blockPos[3];
+	int modelPos[3];
+	for (int x = offset[0]; x < state.blockSize[0] + offset[0]; x++) {
+		blockPos[0] = x;
+		modelPos[0] = x + blockStart[0] - offset[0];
+		for (int y = offset[1]; y < state.blockSize[1] + offset[1]; y++) {
+			blockPos[1] = y;
+			modelPos[1] = y + blockStart[1] - offset[1];
+			for (int z = offset[2]; z < state.blockSize[2] + offset[2]; z++) {
+				blockPos[2] = z;
+				modelPos[2] = z + blockStart[2] - offset[2];
+				int label = fixedLabel(modelPos);
+				if (label >= 0 && !state.propagator->setBlockLabel(label, blockPos)) {
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+void Synthesizer::synthesizeSerially(const int shifts[3], const int numSteps[3], const int maxBlockStart[3]) {
 	// Logic for how to print the iterations.
 	PrintMode printMode[3];
 	int indentation[3];
@@ -157,22 +351,20 @@ void Synthesizer::synthesize(microseconds& synthesisTime) {
 		printMode[lastPrint] = TEXT;
 	}
 
-	int blocks = 0;
-
-
 	bool modifyInBlocks = (lastPrint >= 0);
 	// Whether or not we should fill in the boundary values. We do not do 
 	// this if they would be outside the model. This is for the boundary
 	// in six directions: -X, +X, -Y, +Y, -Z, +Z.
 	bool hasBoundary[6];
+	int blockStart[3];
 	for (int xStep = 0; xStep < numSteps[0]; xStep++) {
-		blockStart[0] = setupStepValues(0, xStep, shifts, maxBlockStart, hasBoundary);
+		blockStart[0] = setupStepValues(0, xStep, shifts, maxBlockStart, wraps, hasBoundary);
 		printIteration(blockStart[0], printMode[0], indentation[0], "x");
 		for (int yStep = 0; yStep < numSteps[1]; yStep++) {
-			blockStart[1] = setupStepValues(1, yStep, shifts, maxBlockStart, hasBoundary);
+			blockStart[1] = setupStepValues(1, yStep, shifts, maxBlockStart, wraps, hasBoundary);
 			printIteration(blockStart[1], printMode[1], indentation[1], "y");
 			for (int zStep = 0; zStep < numSteps[2]; zStep++) {
-				blockStart[2] = setupStepValues(2, zStep, shifts, maxBlockStart, hasBoundary);
+				blockStart[2] = setupStepValues(2, zStep, shifts, maxBlockStart, wraps, hasBoundary);
 				printIteration(blockStart[2], printMode[2], indentation[2], "z");
 				// If the model is in 3D we also include a boundary for z-values to force a
 				// ground plane to appear.
@@ -180,26 +372,15 @@ void Synthesizer::synthesize(microseconds& synthesisTime) {
 					hasBoundary[4] = true;
 					hasBoundary[5] = true;
 				}
-				bool success = false;
-				int attempts = 0;
-				if (modifyInBlocks) {
-					saveBlock(blockStart);
-				}
-				while (!success && attempts < numAttempts) {
-					success = synthesizeBlock(blockStart, hasBoundary);
-					attempts++;
-					if (!success) {
-						if (attempts < numAttempts) {
-							if (lastPrint == -1) {
-								cout << "  Failed. Retrying..." << endl;
-							}
-						} else {
-							if (modifyInBlocks) {
-								restoreBlock(blockStart);
-							}
-							cout << "  Failed. Max Attempts." << endl;
-						}
-					}
+				if (settings->adaptiveBlocks && modifyInBlocks) {
+					int level = splitLevel;
+					BlockState* state = speculativeAttempts > 1 ? nullptr : states[0];
+					bool success = synthesizeAdaptively(state, blockStart, hasBoundary, level);
+					recordAdaptiveBlock(success, level);
+				} else if (speculativeAttempts > 1) {
+					synthesizeBlockSpeculatively(blockStart, hasBoundary, modifyInBlocks);
+				} else {
+					synthesizeBlockWithRetries(*states[0], blockStart, hasBoundary, modifyInBlocks);
 				}
 			}
 		}
@@ -207,17 +388,282 @@ void Synthesizer::synthesize(microseconds& synthesisTime) {
 	if (lastPrint >= 0) {
 		cout << endl;
 	}
-	auto endTime = high_resolution_clock::now();
-	synthesisTime += duration_cast<microseconds>(endTime - startTime);
 }
 
-// Find the label at a given position in the model.
-int Synthesizer::getLabel(int position[3]) {
-	return model[position[0]][position[1]][position[2]];
+void Synthesizer::synthesizeInPhases(const int shifts[3], const int numSteps[3], const int maxBlockStart[3]) {
+	// A block writes its own cells and reads the cells one past it, so each
+	// block is put in the phase after the last block before it in the serial
+	// sweep that it overlaps. Every block then reads the same cells as in the
+	// serial sweep, and the blocks in a phase do not overlap, so they can be
+	// synthesized at the same time. Only blocks within reach steps of each
+	// other along every dimension can overlap, counting around the model
+	// where the blocks wrap. The last step can be less than a shift past the
+	// one before it, hence the extra step.
+	int reach[3];
+	int span[3];
+	for (int dim = 0; dim < 3; dim++) {
+		reach[dim] = min(blockSize[dim] / shifts[dim] + 1, numSteps[dim] - 1);
+		span[dim] = 2 * reach[dim] + 1;
+	}
+	int numBlocks = numSteps[0] * numSteps[1] * numSteps[2];
+	int numNearby = span[0] * span[1] * span[2];
+	vector<BlockPosition> blocks(numBlocks);
+	vector<int> phaseOf(numBlocks);
+	vector<vector<BlockPosition>> phases;
+	for (int i = 0; i < numBlocks; i++) {
+		int steps[3] = { i / (numSteps[1] * numSteps[2]), (i / numSteps[2]) % numSteps[1], i % numSteps[2] };
+		BlockPosition& block = blocks[i];
+		for (int dim = 0; dim < 3; dim++) {
+			block.blockStart[dim] = setupStepValues(dim, steps[dim], shifts, maxBlockStart, wraps, block.hasBoundary);
+		}
+		if (size[2] > 1) {
+			block.hasBoundary[4] = true;
+			block.hasBoundary[5] = true;
+		}
+
+		int phase = 0;
+		for (int k = 0; k < numNearby; k++) {
+			int delta[3] = { k / (span[1] * span[2]) - reach[0], (k / span[2]) % span[1] - reach[1], k % span[2] - reach[2] };
+			int nearby[3];
+			bool inModel = true;
+			for (int dim = 0; dim < 3; dim++) {
+				nearby[dim] = steps[dim] + delta[dim];
+				if (wraps[dim]) {
+					nearby[dim] = (nearby[dim] + numSteps[dim]) % numSteps[dim];
+				} else if (nearby[dim] < 0 || nearby[dim] >= numSteps[dim]) {
+					inModel = false;
+				}
+			}
+			if (!inModel) {
+				continue;
+			}
+			int j = (nearby[0] * numSteps[1] + nearby[1]) * numSteps[2] + nearby[2];
+			if (j < i && blocksOverlap(blocks[j].blockStart, block.blockStart)) {
+				phase = max(phase, phaseOf[j] + 1);
+			}
+		}
+		phaseOf[i] = phase;
+		if (phase == (int)phases.size()) {
+			phases.emplace_back();
+		}
+		phases[phase].push_back(block);
+	}
+
+	for (const vector<BlockPosition>& phase : phases) {
+		synthesizePhase(phase);
+	}
+}
+
+// Whether one block reads or writes a cell that the other block writes.
+bool Synthesizer::blocksOverlap(const int startA[3], const int startB[3]) const {
+	for (int dim = 0; dim < 3; dim++) {
+		int distance = abs(startA[dim] - startB[dim]);
+		if (wraps[dim]) {
+			distance = min(distance, size[dim] - distance);
+		}
+		if (distance > blockSize[dim]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void Synthesizer::synthesizePhase(const vector<BlockPosition>& phase) {
+	threadPool->parallelFor((int)phase.size(), [&](int i, int worker) {
+		BlockPosition block = phase[i];
+		synthesizeBlockWithRetries(*states[worker], block.blockStart, block.hasBoundary, true);
+	});
+}
+
+// The seed for an attempt at a block. The first attempt uses the block's own
+// seed.
+uint64_t Synthesizer::attemptSeed(const int blockStart[3], int attempt) {
+	uint64_t blockSeed = Random::mix(seed, numSyntheses);
+	for (int dim = 0; dim < 3; dim++) {
+		blockSeed = Random::mix(blockSeed, blockStart[dim]);
+	}
+	if (attempt > 0) {
+		blockSeed = Random::mix(blockSeed, attempt);
+	}
+	return blockSeed;
+}
+
+// Report that the given number of attempts at a block have failed.
+void Synthesizer::reportFailure(int attempts, bool modifyInBlocks, bool willSplit) {
+	lock_guard<mutex> lock(printMutex);
+	if (attempts < numAttempts) {
+		if (!modifyInBlocks) {
+			cout << "  Failed. Retrying..." << endl;
+		}
+	} else if (willSplit) {
+		cout << "  Failed. Splitting the block." << endl;
+	} else {
+		cout << "  Failed. Max Attempts." << endl;
+	}
+}
+
+bool Synthesizer::synthesizeBlockWithRetries(BlockState& state, int blockStart[3], bool hasBoundary[6], bool modifyInBlocks) {
+	if (modifyInBlocks) {
+		// The boundary is different at every block position.
+		state.hasSnapshot = false;
+	}
+	for (int attempt = 0; attempt < numAttempts; attempt++) {
+		state.random.setSeed(attemptSeed(blockStart, attempt));
+		if (synthesizeBlock(state, blockStart, hasBoundary)) {
+			commitBlock(state, blockStart);
+			return true;
+		}
+		reportFailure(attempt + 1, modifyInBlocks, state.canSplit);
+	}
+	return false;
+}
+
+bool Synthesizer::synthesizeBlockSpeculatively(int blockStart[3], bool hasBoundary[6], bool modifyInBlocks) {
+	if (modifyInBlocks) {
+		for (BlockState* state : states) {
+			state->hasSnapshot = false;
+		}
+	}
+
+	// Run the attempts in batches. Every attempt has its own seed, and the
+	// first attempt to succeed in attempt order wins, so the result is the
+	// same as running the attempts one at a time. An attempt only gives up
+	// early once an attempt before it has succeeded.
+	int batchSize = speculativeAttempts;
+	for (int first = 0; first < numAttempts; first += batchSize) {
+		int count = min(batchSize, numAttempts - first);
+		atomic<int> firstSuccess(numAttempts);
+		int winner = -1;
+		mutex winnerMutex;
+		threadPool->parallelFor(count, [&](int i, int worker) {
+			int attempt = first + i;
+			if (firstSuccess.load() < attempt) {
+				return;
+			}
+			BlockState& state = *states[worker];
+			state.random.setSeed(attemptSeed(blockStart, attempt));
+			state.firstSuccess = &firstSuccess;
+			state.attempt = attempt;
+			bool success = synthesizeBlock(state, blockStart, hasBoundary);
+			state.firstSuccess = nullptr;
+			if (success) {
+				lock_guard<mutex> lock(winnerMutex);
+				if (attempt < firstSuccess.load()) {
+					firstSuccess = attempt;
+					winner = worker;
+				}
+			}
+		});
+
+		int lastFailed = min(firstSuccess.load(), first + count);
+		for (int attempt = first; attempt < lastFailed; attempt++) {
+			reportFailure(attempt + 1, modifyInBlocks, states[0]->canSplit);
+		}
+		if (winner != -1) {
+			commitBlock(*states[winner], blockStart);
+			return true;
+		}
+	}
+	return false;
+}
+
+void Synthesizer::splitBlock(int level, int splitSize[3], int splitShifts[3], int numSplitSteps[3]) const {
+	for (int dim = 0; dim < 3; dim++) {
+		splitSize[dim] = blockSize[dim];
+		if (blockSize[dim] < size[dim]) {
+			splitSize[dim] = max(blockSize[dim] >> min(level, 30), min(minAdaptiveBlockSize, blockSize[dim]));
+		}
+		splitShifts[dim] = max(splitSize[dim] / 2, 1);
+		numSplitSteps[dim] = (blockSize[dim] - splitSize[dim] + splitShifts[dim] - 1) / splitShifts[dim] + 1;
+	}
+}
+
+bool Synthesizer::canSplit(int level) const {
+	int splitSize[3], nextSize[3], shifts[3], numSteps[3];
+	splitBlock(level, splitSize, shifts, numSteps);
+	splitBlock(level + 1, nextSize, shifts, numSteps);
+	return splitSize[0] != nextSize[0] || splitSize[1] != nextSize[1] || splitSize[2] != nextSize[2];
+}
+
+void Synthesizer::setBlockSize(BlockState& state, const int newBlockSize[3], bool newCanSplit) {
+	for (int dim = 0; dim < 3; dim++) {
+		state.blockSize[dim] = newBlockSize[dim];
+	}
+	state.propagator->setBlockExtent(newBlockSize);
+	state.hasSnapshot = false;
+	state.canSplit = newCanSplit;
+}
+
+bool Synthesizer::synthesizeSplitBlock(BlockState* state, int blockStart[3], bool hasBoundary[6], int level) {
+	int splitSize[3], shifts[3], numSteps[3];
+	splitBlock(level, splitSize, shifts, numSteps);
+	// Speculative attempts may run on any of the states.
+	vector<BlockState*> used = state != nullptr ? vector<BlockState*>{ state } : states;
+	for (BlockState* each : used) {
+		setBlockSize(*each, splitSize, canSplit(level));
+	}
+
+	// Each smaller block is bounded by the cells around it, like the blocks
+	// in the model, and by the block's own boundary on its outer sides.
+	bool success = true;
+	int numBlocks = numSteps[0] * numSteps[1] * numSteps[2];
+	for (int i = 0; i < numBlocks && success; i++) {
+		int steps[3] = { i / (numSteps[1] * numSteps[2]), (i / numSteps[2]) % numSteps[1], i % numSteps[2] };
+		int splitStart[3];
+		bool splitBoundary[6];
+		for (int dim = 0; dim < 3; dim++) {
+			int maxStart = blockSize[dim] - splitSize[dim];
+			int value = min(steps[dim] * shifts[dim], maxStart);
+			splitStart[dim] = blockStart[dim] + value;
+			splitBoundary[2 * dim] = value > 0 || hasBoundary[2 * dim];
+			splitBoundary[2 * dim + 1] = value < maxStart || hasBoundary[2 * dim + 1];
+		}
+		if (state != nullptr) {
+			success = synthesizeBlockWithRetries(*state, splitStart, splitBoundary, true);
+		} else {
+			success = synthesizeBlockSpeculatively(splitStart, splitBoundary, true);
+		}
+	}
+
+	for (BlockState* each : used) {
+		setBlockSize(*each, blockSize, false);
+	}
+	return success;
+}
+
+bool Synthesizer::synthesizeAdaptively(BlockState* state, int blockStart[3], bool hasBoundary[6], int& level) {
+	while (!synthesizeSplitBlock(state, blockStart, hasBoundary, level)) {
+		if (!canSplit(level)) {
+			return false;
+		}
+		level++;
+	}
+	return true;
+}
+
+void Synthesizer::recordAdaptiveBlock(bool success, int level) {
+	if (success) {
+		int splitSize[3], shifts[3], numSteps[3];
+		splitBlock(level, splitSize, shifts, numSteps);
+		blockSizeCounts[{ splitSize[0], splitSize[1], splitSize[2] }] += numSteps[0] * numSteps[1] * numSteps[2];
+	}
+	if (level > splitLevel) {
+		splitLevel = level;
+		successStreak = 0;
+	} else if (success) {
+		successStreak++;
+		if (successStreak >= growAfterSuccesses && splitLevel > 0) {
+			splitLevel--;
+			successStreak = 0;
+		}
+	} else {
+		successStreak = 0;
+	}
 }
 
 // Adds all the labels on the boundary of the blocks in a particular direction.
-void Synthesizer::addBoundary(int blockStart[3], int dir) {
+// Returns false if a cell has no possible labels left.
+bool Synthesizer::addBoundary(BlockState& state, int blockStart[3], int dir) {
 	// dim1 and dim2 are the two other dimensions.
 	int dim0 = dir / 2;
 	int dim1 = -1;
@@ -228,70 +674,112 @@ void Synthesizer::addBoundary(int blockStart[3], int dir) {
 		case 2: dim1 = 0; dim2 = 1; break;
 	}
 
-	int blockPos[3];
-	int modelPos[3];
+	// The position of the boundary in the block and in the model.
+	int blockPos;
 	if (dir % 2) {
-		blockPos[dim0] = blockSize[dim0] - 1 + offset[dim0];
+		blockPos = state.blockSize[dim0] - 1 + offset[dim0];
+		// On the far edge of a periodic model the block's last cell is
+		// synthesized too, and the boundary is the cell past it, which wraps
+		// around to the first cell of the model.
+		if (wraps[dim0] && blockStart[dim0] + state.blockSize[dim0] == size[dim0]) {
+			blockPos++;
+		}
 	} else {
-		blockPos[dim0] = 0;
+		blockPos = 0;
 	}
-	modelPos[dim0] = blockPos[dim0] + blockStart[dim0] - offset[dim0];
-	for (int i = offset[dim1]; i < blockSize[dim1] + offset[dim1]; i++) {
-		blockPos[dim1] = i;
-		modelPos[dim1] = i + blockStart[dim1] - offset[dim1];
-		for (int j = offset[dim2]; j < blockSize[dim2] + offset[dim2]; j++) {
-			blockPos[dim2] = j;
-			modelPos[dim2] = j + blockStart[dim2] - offset[dim2];
-			propagator->setBlockLabel(getLabel(modelPos), blockPos);
+	int modelPos = (blockPos + blockStart[dim0] - offset[dim0] + size[dim0]) % size[dim0];
+	// The cell at offset in the block is at blockStart in the model.
+	int labelStart[2] = { blockStart[dim1], blockStart[dim2] };
+	return setPlane(state.propagator, dim0, blockPos, state.blockSize, offset, model->slab(dim0, modelPos), labelStart);
+}
+
+// Set the labels in one plane of the block from the labels in the slab.
+// Returns false if a cell has no possible labels left.
+bool Synthesizer::setPlane(Propagator* propagator, int dim, int planePos, const int extent[3], const int offset[3], const LabelSlab& labels, const int labelStart[2]) {
+	// dim1 and dim2 are the two other dimensions, which are the slab's axes.
+	int dim1 = dim == 0 ? 1 : 0;
+	int dim2 = dim == 2 ? 1 : 2;
+	int position[3];
+	position[dim] = planePos;
+	for (int i = 0; i < extent[dim1]; i++) {
+		position[dim1] = i + offset[dim1];
+		// The labels on this line of the plane.
+		LabelRow line = labels.row(i + labelStart[0]);
+		for (int j = 0; j < extent[dim2]; j++) {
+			position[dim2] = j + offset[dim2];
+			if (!propagator->setBlockLabel(line[j + labelStart[1]], position)) {
+				return false;
+			}
 		}
 	}
+	return true;
 }
 
-// Set the labels to create a ground plane.
-void Synthesizer::addGround(int blockStart[3]) {
-	if (blockSize[1] - offset[1] + blockStart[1] + offset[1] == size[1]) {
+// Set the labels to create a ground plane. Returns false if a cell has no
+// possible labels left.
+bool Synthesizer::addGround(BlockState& state, int blockStart[3]) {
+	if (state.blockSize[1] - offset[1] + blockStart[1] + offset[1] == size[1]) {
 		int position[3];
 		position[2] = 0;
-		for (int x = offset[0]; x < blockSize[0] + offset[0]; x++) {
+		for (int x = offset[0]; x < state.blockSize[0] + offset[0]; x++) {
 			position[0] = x;
-			for (int y = offset[1]; y < blockSize[1] + offset[1]; y++) {
+			for (int y = offset[1]; y < state.blockSize[1] + offset[1]; y++) {
 				position[1] = y;
-				if (y == blockSize[1] - 1) {
-					propagator->setBlockLabel(settings->ground, position);
-				} else if (propagator->isPossible(x, y, 0, settings->ground)) {
-					propagator->removeLabel(settings->ground, position);
+				bool success = true;
+				// The ground is on the model's last row. In a periodic model the
+				// boundary past it wraps around to the first row.
+				if (y == state.blockSize[1] - 1 + offset[1]) {
+					success = state.propagator->setBlockLabel(settings->ground, position);
+				} else if (state.propagator->isPossible(x, y, 0, settings->ground)) {
+					success = state.propagator->removeLabel(settings->ground, position);
+				}
+				if (!success) {
+					return false;
 				}
 			}
 		}
 	}
+	return true;
 }
 
 // Remove labels with no support in any particular direction. Those labels
-// can only be on the boundary of the model.
-void Synthesizer::removeNoSupport(int blockStart[3]) {
-	int numDirections = 2 * settings->numDims;
-	std::deque<vector<int>> updateQueue;
-	for (int i = 0; i < numLabels; i++) {
+// can only be on the boundary of the model, and a periodic model has no
+// boundary in x or y. Returns false if a cell has no possible labels left.
+bool Synthesizer::removeNoSupport(BlockState& state, int blockStart[3]) {
+	bool onEdge[6];
+	for (int dim = 0; dim < 3; dim++) {
+		bool hasEdges = dim == 2 || !settings->periodic;
+		onEdge[2 * dim] = hasEdges && blockStart[dim] == 0;
+		onEdge[2 * dim + 1] = hasEdges && blockStart[dim] + state.blockSize[dim] == size[dim];
+	}
+	return removeNoSupport(*settings, state.propagator, state.blockSize, offset, onEdge);
+}
+
+// Remove the labels with no support in some direction from the block, except
+// from the cells on a side of the block that is on the edge of the model in
+// that direction. Returns false if a cell has no possible labels left.
+bool Synthesizer::removeNoSupport(const InputSettings& settings, Propagator* propagator, const int extent[3], const int offset[3], const bool onEdge[6]) {
+	int numDirections = 2 * settings.numDims;
+	for (int i = 0; i < settings.numLabels; i++) {
 		for (int dir = 0; dir < numDirections; dir++) {
-			if (settings->supportCount[i][dir] == 0) {
-				int position[3];
-				for (int x = offset[0]; x < blockSize[0] + offset[0]; x++) {
-					position[0] = x;
-					for (int y = offset[1]; y < blockSize[1] + offset[1]; y++) {
-						position[1] = y;
-						for (int z = offset[2]; z < blockSize[2] + offset[2]; z++) {
-							position[2] = z;
-							bool remove = false;
-							switch (dir) {
-								case 0: remove = x + blockStart[0] - offset[0] != size[0] - 1; break;
-								case 1: remove = x + blockStart[0] - offset[0] != 0; break;
-								case 2: remove = y + blockStart[1] - offset[1] != size[1] - 1; break;
-								case 3: remove = y + blockStart[1] - offset[1] != 0; break;
-								case 4: remove = z + blockStart[2] - offset[2] != size[2] - 1; break;
-								case 5: remove = z + blockStart[2] - offset[2] != 0; break;
-							}
-							if (remove && propagator->isPossible(x, y, z, i)) {
-								propagator->removeLabel(i, position);
+			if (settings.supportCount[i][dir] != 0) {
+				continue;
+			}
+			// A label with no support in this direction can only be on the
+			// side facing the opposite way.
+			int dim = dir / 2;
+			int edgePos = (dir % 2) ? offset[dim] : extent[dim] - 1 + offset[dim];
+			int position[3];
+			for (int x = offset[0]; x < extent[0] + offset[0]; x++) {
+				position[0] = x;
+				for (int y = offset[1]; y < extent[1] + offset[1]; y++) {
+					position[1] = y;
+					for (int z = offset[2]; z < extent[2] + offset[2]; z++) {
+						position[2] = z;
+						bool remove = !onEdge[dir ^ 1] || position[dim] != edgePos;
+						if (remove && propagator->isPossible(x, y, z, i)) {
+							if (!propagator->removeLabel(i, position)) {
+								return false;
 							}
 						}
 					}
@@ -299,62 +787,150 @@ void Synthesizer::removeNoSupport(int blockStart[3]) {
 			}
 		}
 	}
+	return true;
+}
+
+// Copy the labels picked for the block into the model.
+void Synthesizer::commitBlock(const BlockState& state, int blockStart[3]) {
+	// The cell at offset in the block is at blockStart in the model.
+	model->copyBlock(*state.pickedBlock, offset, blockStart, state.blockSize);
 }
 
-void Synthesizer::saveBlock(int blockStart[3]) {
-	for (int x = offset[0]; x < blockSize[0] + offset[0]; x++) {
-		for (int y = offset[1]; y < blockSize[1] + offset[1]; y++) {
-			for (int z = offset[2]; z < blockSize[2] + offset[2]; z++) {
-				savedBlock[x][y][z] = 
-					model[x + blockStart[0] - offset[0]]
-					     [y + blockStart[1] - offset[1]]
-				         [z + blockStart[2] - offset[2]];
+// Modifying the labels within a particular block. The block can be as big
+// as the whole model.
+bool Synthesizer::synthesizeBlock(BlockState& state, int blockStart[3], bool hasBoundary[6]) {
+	if (state.hasSnapshot) {
+		state.propagator->restoreSnapshot();
+	} else {
+		// Stop as soon as the boundary or ground leaves a cell with no
+		// labels. The snapshot is not saved, so the next attempt starts over.
+		state.propagator->resetBlock();
+		for (int dir = 0; dir < 6; dir++) {
+			if (hasBoundary[dir] && !addBoundary(state, blockStart, dir)) {
+				return false;
 			}
 		}
+		if (settings->ground >= 0 && !addGround(state, blockStart)) {
+			return false;
+		}
+		if (settings->useAc4) {
+			// removeNoSupport is only necessary for AC-4.
+			// In AC-3 theses labels are removed during propagation.
+			if (!removeNoSupport(state, blockStart)) {
+				return false;
+			}
+		}
+		if (region != nullptr && !addFixedLabels(state, blockStart)) {
+			return false;
+		}
+		state.propagator->saveSnapshot();
+		state.hasSnapshot = true;
 	}
+
+	if (settings->backtrackDepth > 0) {
+		return pickLabelsWithBacktracking(state);
+	}
+	return pickLabels(state, offset);
 }
 
-void Synthesizer::restoreBlock(int blockStart[3]) {
-	for (int x = offset[0]; x < blockSize[0] + offset[0]; x++) {
-		for (int y = offset[1]; y < blockSize[1] + offset[1]; y++) {
-			for (int z = offset[2]; z < blockSize[2] + offset[2]; z++) {
-				model[x + blockStart[0] - offset[0]]
-					 [y + blockStart[1] - offset[1]]
-				     [z + blockStart[2] - offset[2]] = savedBlock[x][y][z];
+// Pick a label for every cell in the block, sweeping along x, y and z.
+// Returns false if a cell has no labels left or the attempt is cancelled.
+bool Synthesizer::pickLabels(BlockState& state, const int offset[3]) {
+	for (int x = offset[0]; x < state.blockSize[0] + offset[0]; x++) {
+		for (int y = offset[1]; y < state.blockSize[1] + offset[1]; y++) {
+			for (int z = offset[2]; z < state.blockSize[2] + offset[2]; z++) {
+				if (state.isCancelled()) {
+					return false;
+				}
+				// A cell with one label left is already decided and its
+				// neighbors are consistent with it, so nothing is propagated.
+				int label = state.propagator->singleLabel(x, y, z);
+				if (label == -1) {
+					label = state.propagator->pickLabel(x, y, z, state.random);
+				}
+				if (label == -1) {
+					return false;
+				}
+				state.pickedBlock->set(x, y, z, label);
 			}
 		}
 	}
+	return true;
 }
 
-// Modifying the labels within a particular block. The block can be as big
-// as the whole model.
-bool Synthesizer::synthesizeBlock(int blockStart[3], bool hasBoundary[6]) {
-	propagator->resetBlock();
-	for (int dir = 0; dir < 6; dir++) {
-		if (hasBoundary[dir]) {
-			addBoundary(blockStart, dir);
+// Pick the labels in the block in the same order as synthesizeBlock. When a
+// cell has no labels left, undo the most recent picks one at a time and
+// remove the label that was picked, up to backtrackDepth picks back.
+bool Synthesizer::pickLabelsWithBacktracking(BlockState& state) {
+	struct Pick {
+		int index;
+		int label;
+		int checkpoint;
+	};
+	std::deque<Pick> picks;
+	int numCells = state.blockSize[0] * state.blockSize[1] * state.blockSize[2];
+	int backtracks = 0;
+	int index = 0;
+	while (index < numCells) {
+		int position[3];
+		position[0] = index / (state.blockSize[1] * state.blockSize[2]) + offset[0];
+		position[1] = (index / state.blockSize[2]) % state.blockSize[1] + offset[1];
+		position[2] = index % state.blockSize[2] + offset[2];
+
+		if (state.isCancelled()) {
+			return false;
 		}
-	}
-	if (settings->ground >= 0) {
-		addGround(blockStart);
-	}
-	if (settings->useAc4) {
-		// removeNoSupport is only necessary for AC-4.
-		// In AC-3 theses labels are removed during propagation.
-		removeNoSupport(blockStart);
-	}
 
-	for (int x = offset[0]; x < blockSize[0] + offset[0]; x++) {
-		for (int y = offset[1]; y < blockSize[1] + offset[1]; y++) {
-			for (int z = offset[2]; z < blockSize[2] + offset[2]; z++) {
-				int label = propagator->pickLabel(x, y, z);
-				if (label == -1) {
-					return false;
-				}
-				model[x + blockStart[0] - offset[0]]
-					 [y + blockStart[1] - offset[1]]
-				     [z + blockStart[2] - offset[2]] = label;
+		// A decided cell is not a pick, so it is never undone on its own.
+		int single = state.propagator->singleLabel(position[0], position[1], position[2]);
+		if (single != -1) {
+			state.pickedBlock->set(position[0], position[1], position[2], single);
+			index++;
+			continue;
+		}
+
+		int checkpoint = state.propagator->checkpoint();
+		int label = state.propagator->chooseLabel(position[0], position[1], position[2], state.random);
+		if (label != -1 && state.propagator->setBlockLabel(label, position)) {
+			state.pickedBlock->set(position[0], position[1], position[2], label);
+			picks.push_back({ index, label, checkpoint });
+			if ((int)picks.size() > settings->backtrackDepth) {
+				picks.pop_front();
 			}
+			index++;
+			continue;
+		}
+
+		// Rule out the label that led to a cell with no labels and try this
+		// cell again.
+		state.propagator->rollback(checkpoint);
+		if (label != -1 && backtracks < maxBacktracks) {
+			backtracks++;
+			if (state.propagator->removeLabel(label, position)) {
+				continue;
+			}
+		}
+
+		// Go back to the last pick and rule out the label that was chosen.
+		// If that leaves the cell with no labels, keep going back.
+		bool recovered = false;
+		while (!picks.empty() && backtracks < maxBacktracks) {
+			Pick pick = picks.back();
+			picks.pop_back();
+			backtracks++;
+			state.propagator->rollback(pick.checkpoint);
+			int pickPosition[3];
+			pickPosition[0] = pick.index / (state.blockSize[1] * state.blockSize[2]) + offset[0];
+			pickPosition[1] = (pick.index / state.blockSize[2]) % state.blockSize[1] + offset[1];
+			pickPosition[2] = pick.index % state.blockSize[2] + offset[2];
+			if (state.propagator->removeLabel(pick.label, pickPosition)) {
+				index = pick.index;
+				recovered = true;
+				break;
+			}
+		}
+		if (!recovered) {
+			return false;
 		}
 	}
 	return true;
@@ -366,7 +942,7 @@ void Synthesizer::printModel() {
 	for (int z = 0; z < size[2]; z++) {
 		for (int y = 0; y < size[1]; y++) {
 			for (int x = 0; x < size[0]; x++) {
-				cout << model[x][y][z] << " ";
+				cout << model->get(x, y, z) << " ";
 			}
 			cout << endl;
 		}
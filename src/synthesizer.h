@@ -4,58 +4,291 @@
 
 #include "parseInput/parseInput.h"
 #include "propagator/Propagator.h"
+#include "LabelGrid.h"
+#include "Random.h"
+#include "ThreadPool.h"
+#include <array>
 #include <deque>
+#include <map>
 #include <vector>
 #include <chrono>
+#include <mutex>
+#include <atomic>
+
+// Everything needed to synthesize one block at a time. When blocks are
+// synthesized in parallel, each thread has its own.
+struct BlockState {
+	// Propagates the set of possible labels.
+	Propagator* propagator;
+
+	// Picks the labels. This is seeded again at the start of every block
+	// from the model's seed, the number of times synthesize has been
+	// called, and the block's position, so a block's labels do not depend
+	// on which blocks were synthesized before it.
+	Random random;
+
+	// The labels picked for the block. These are copied into the model once
+	// every cell has a label, so a failed attempt leaves the model as it was.
+	LabelGrid* pickedBlock;
+
+	// The size of the block being synthesized. This is the block size in
+	// the settings unless adaptive blocks have been split.
+	int blockSize[3];
+
+	// Whether the block is split into smaller blocks if every attempt at it
+	// fails.
+	bool canSplit;
+
+	// Whether the propagator holds a snapshot of the state after the
+	// boundary, ground and unsupported labels have been applied. This is
+	// the same on every attempt at a block, and in every iteration when
+	// the whole model is one block.
+	bool hasSnapshot;
+
+	// Set while attempts at a block run in parallel. The attempt gives up
+	// once an attempt before it has succeeded.
+	const std::atomic<int>* firstSuccess;
+	int attempt;
+
+	bool isCancelled() const {
+		return firstSuccess != nullptr && firstSuccess->load(std::memory_order_relaxed) < attempt;
+	}
+};
+
+// A block position and which of its sides take their labels from the model.
+struct BlockPosition {
+	int blockStart[3];
+	bool hasBoundary[6];
+};
+
+// A label a cell must have when a region is synthesized again.
+struct PinnedLabel {
+	int position[3];
+	int label;
+};
+
+// A part of the model to synthesize again, keeping the rest of the model.
+struct Region {
+	// The box of cells to synthesize again, from start up to but not
+	// including end.
+	int start[3];
+	int end[3];
+
+	// If not empty, only the cells in the box where this is true are
+	// synthesized again and the others keep their labels. It is indexed by
+	// the position in the box with z changing fastest.
+	std::vector<bool> mask;
+
+	// Cells in the box that must have the given labels.
+	std::vector<PinnedLabel> pins;
+};
 
 class Synthesizer {
 	private:
-		int*** model;
-		int*** savedBlock;
+		LabelGrid* model;
 		InputSettings* settings;
 		int* size;
 		int* blockSize;
 		int* offset;
 		int numLabels;
 		int numDirections;
+		int* possibilitySize;
+		int numSyntheses;
+
+		// Whether the blocks wrap around the edge of the model along each
+		// dimension. This is true along x and y for a periodic model that is
+		// modified in blocks along that dimension. The blocks on one edge are
+		// then bounded by the cells on the opposite edge.
+		bool wraps[3];
+
+		// With adaptive blocks, how many times the block size in the settings
+		// is halved for the next block, and how many blocks in a row have
+		// succeeded at that size without being split.
+		int splitLevel;
+		int successStreak;
+
+		// With adaptive blocks, how many blocks have been synthesized at each
+		// size.
+		std::map<std::array<int, 3>, int> blockSizeCounts;
+
+		// The seed every block's seed is derived from. This starts as the
+		// seed in the settings.
+		uint64_t seed;
+
+		// The threads and speculative attempts to use, from the settings.
+		// Both are 1 in a batch, where each synthesizer already has a thread
+		// of its own.
+		int numThreads;
+		int speculativeAttempts;
+
+		// The state for each thread. Only the first is used when the blocks
+		// are synthesized one at a time.
+		std::vector<BlockState*> states;
+
+		// Runs the blocks in each phase, or the speculative attempts at a
+		// block, in parallel. This is null unless the settings ask for more
+		// than one thread or speculative attempts.
+		ThreadPool* threadPool;
+		// Keeps the messages from different threads from interleaving.
+		std::mutex printMutex;
 
-		// Propagates the set of possible labels.
-		Propagator* propagator;
+		// Create the state for one thread.
+		BlockState* createState();
+
+		// Fill the model with the initial labels and the rows leading down to
+		// the ground plane.
+		void fillInitialLabels();
+
+		// The seed for an attempt at a block.
+		uint64_t attemptSeed(const int blockStart[3], int attempt);
+
+		// Print that the given number of attempts at a block have failed.
+		void reportFailure(int attempts, bool modifyInBlocks, bool willSplit);
+
+		// Synthesize the block, retrying up to numAttempts times. The model is
+		// only changed if an attempt succeeds. Returns false if every attempt
+		// failed.
+		bool synthesizeBlockWithRetries(BlockState& state, int blockStart[3], bool hasBoundary[6], bool modifyInBlocks);
+
+		// Like synthesizeBlockWithRetries, but runs speculativeAttempts
+		// attempts at a time on the thread pool. The result is the same as
+		// running them one at a time.
+		bool synthesizeBlockSpeculatively(int blockStart[3], bool hasBoundary[6], bool modifyInBlocks);
+
+		// The size of the blocks after halving the block size in the settings
+		// the given number of times, and the shifts and steps that sweep them
+		// through one block of the settings' size. Only the dimensions the
+		// model is modified in blocks along are halved.
+		void splitBlock(int level, int splitSize[3], int splitShifts[3], int numSplitSteps[3]) const;
+
+		// Whether halving the blocks once more makes them smaller.
+		bool canSplit(int level) const;
+
+		// Change the size of the block the state synthesizes.
+		void setBlockSize(BlockState& state, const int newBlockSize[3], bool newCanSplit);
+
+		// Synthesize the block as smaller blocks of the size at the level,
+		// swept through it in the same way as the blocks through the model.
+		// The state is null to run speculative attempts. Returns false if one
+		// of the smaller blocks failed.
+		bool synthesizeSplitBlock(BlockState* state, int blockStart[3], bool hasBoundary[6], int level);
+
+		// Synthesize an adaptive block, starting at the level and splitting
+		// it further each time a smaller block fails. level is set to the
+		// level the block was last tried at. Returns false if it failed at
+		// the smallest size.
+		bool synthesizeAdaptively(BlockState* state, int blockStart[3], bool hasBoundary[6], int& level);
+
+		// Count an adaptive block and choose the level for the next one. The
+		// blocks after one that had to be split start at its level, and grow
+		// back once enough blocks in a row succeed at their first size.
+		void recordAdaptiveBlock(bool success, int level);
+
+		// Synthesize the blocks one at a time, sweeping along x, y and z.
+		void synthesizeSerially(const int shifts[3], const int numSteps[3], const int maxBlockStart[3]);
+
+		// Synthesize the blocks in phases. The blocks in a phase do not
+		// overlap, including the cells around them they read the boundary
+		// from, so they are synthesized in parallel. Each block comes after
+		// the blocks before it in the serial sweep that it overlaps, so the
+		// result is the same as the serial sweep.
+		void synthesizeInPhases(const int shifts[3], const int numSteps[3], const int maxBlockStart[3]);
+
+		// Whether one of the blocks at the two positions reads or writes a
+		// cell the other one writes.
+		bool blocksOverlap(const int startA[3], const int startB[3]) const;
+
+		// Synthesize the blocks in one phase in parallel.
+		void synthesizePhase(const std::vector<BlockPosition>& phase);
 
 		// Synthesize a block of the model at the offset position and 
 		// add the boundary. hasBoundary is whether or not we should fill in the
 		// boundary values in the -X, +X, -Y, +Y, -Z, +Z directions.
-		bool synthesizeBlock(int blockStart[3], bool hasBoundary[6]);
+		bool synthesizeBlock(BlockState& state, int blockStart[3], bool hasBoundary[6]);
 
-		// Adds all the labels on the boundary of the blocks in a particular direction.
-		void addBoundary(int blockStart[3], int dir);
+		// Pick a label for every cell in the block, undoing recent picks when
+		// the labels run out.
+		bool pickLabelsWithBacktracking(BlockState& state);
 
-		// Set the labels to create a ground plane.
-		void addGround(int blockStart[3]);
+		// Adds all the labels on the boundary of the blocks in a particular
+		// direction. Returns false if a cell has no possible labels left.
+		bool addBoundary(BlockState& state, int blockStart[3], int dir);
 
-		// Remove labels with no support.
-		void removeNoSupport(int blockStart[3]);
+		// Set the labels to create a ground plane. Returns false if a cell has
+		// no possible labels left.
+		bool addGround(BlockState& state, int blockStart[3]);
 
-		// Return the label at a given position in the model.
-		int getLabel(int* position);
+		// Remove labels with no support. Returns false if a cell has no
+		// possible labels left.
+		bool removeNoSupport(BlockState& state, int blockStart[3]);
 
-		// Save the block we are modifying before we do.
-		void saveBlock(int blockStart[3]);
+		// Copy the labels picked for the block into the model.
+		void commitBlock(const BlockState& state, int blockStart[3]);
 
-		// Restore the block to its previous state.
-		void restoreBlock(int blockStart[3]);
+		// The region being synthesized again, or null when synthesizing the
+		// whole model, and the label pinned at each cell in its box or -1.
+		const Region* region;
+		std::vector<int> regionPins;
+
+		// The label a cell must keep while synthesizing the region, or -1 if
+		// it is synthesized again.
+		int fixedLabel(const int position[3]) const;
+
+		// Set the labels of the cells in the block that must keep them while
+		// synthesizing the region. Returns false if a cell has no possible
+		// labels left.
+		bool addFixedLabels(BlockState& state, int blockStart[3]);
 
 		// This is just for debugging.
 		void printModel();
 
 	public:
-		Synthesizer(InputSettings* newSettings, std::chrono::microseconds& synthesisTime);
+		// A synthesizer in a batch runs on one of the batch's threads, so it
+		// starts no threads of its own and keeps its model in memory rather
+		// than in the model file.
+		Synthesizer(InputSettings* newSettings, std::chrono::microseconds& synthesisTime, bool inBatch = false);
 		~Synthesizer();
 
 		// Synthesize a model from the settings.
 		void synthesize(std::chrono::microseconds& synthesisTime);
 
-		int*** getModel();
+		// Synthesize the cells in the region again, keeping every other cell.
+		// The region is covered with blocks in the same way as the model,
+		// and each block is bounded by the cells around it. Returns false if
+		// a block failed, in which case that block keeps its old labels.
+		bool synthesizeRegion(const Region& newRegion, std::chrono::microseconds& synthesisTime);
+
+		// Replace the model with an existing one of the same size, such as an
+		// edited copy of an earlier output.
+		void setModel(const LabelGrid& labels);
+
+		// Start over from a new seed. The next model synthesized is the same
+		// as the first model from a new synthesizer with this seed.
+		void setSeed(uint64_t newSeed);
+
+		const LabelGrid& getModel() const;
+
+		// Set the labels in the plane at planePos along dim, in the cells of
+		// the block from offset with the given extent. The labels are read
+		// from the slab, where labelStart is the position of the block's
+		// first cell along the slab's two axes. Returns false if a cell has
+		// no possible labels left.
+		static bool setPlane(Propagator* propagator, int dim, int planePos, const int extent[3], const int offset[3], const LabelSlab& labels, const int labelStart[2]);
+
+		// Remove labels with no support in some direction from the block.
+		// onEdge is whether each side of the block, in the -X, +X, -Y, +Y, -Z,
+		// +Z directions, is on the edge of the model, where those labels are
+		// kept. Returns false if a cell has no possible labels left.
+		static bool removeNoSupport(const InputSettings& settings, Propagator* propagator, const int extent[3], const int offset[3], const bool onEdge[6]);
+
+		// Pick a label for every cell in the state's block without
+		// backtracking. Returns false if a cell has no labels left or the
+		// attempt is cancelled.
+		static bool pickLabels(BlockState& state, const int offset[3]);
+
+		// How many blocks have been synthesized at each size with adaptive
+		// blocks, over every model this synthesizer has synthesized.
+		const std::map<std::array<int, 3>, int>& getBlockSizeCounts() const;
 };
 
 